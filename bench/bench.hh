@@ -0,0 +1,90 @@
+#ifndef BENCH_HH
+#define BENCH_HH
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+#include "histogram.hh"
+
+namespace bench
+{
+
+	using clock = std::chrono::steady_clock;
+
+	inline double seconds_since(clock::time_point begin)
+	{
+		return std::chrono::duration<double>(clock::now() - begin).count();
+	}
+
+	inline std::uint64_t nanoseconds(clock::duration d)
+	{
+		return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+	}
+
+	/**
+	 * One JSON object per line on stdout, printed when the report goes out
+	 * of scope: {"bench":"name","key":value,...}
+	 */
+	class report
+	{
+		public:
+			report(const std::string& _name)
+			: m_line("{\"bench\":\"" + _name + "\"")
+			{
+			}
+			report(const report&) = delete;
+			report& operator=(const report&) = delete;
+			~report()
+			{
+				std::printf("%s}\n", m_line.c_str());
+				std::fflush(stdout);
+			}
+			report& operator()(const char* key, double value)
+			{
+				char buffer[64];
+				std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+				return raw(key, buffer);
+			}
+			template<class Integer, std::enable_if_t<std::is_integral_v<Integer> && !std::is_same_v<Integer, bool>, int> = 0>
+			report& operator()(const char* key, Integer value)
+			{
+				return raw(key, std::to_string(value));
+			}
+			report& operator()(const char* key, bool value)
+			{
+				return raw(key, value ? "true" : "false");
+			}
+			report& operator()(const char* key, const char* value)
+			{
+				return raw(key, "\"" + std::string(value) + "\"");
+			}
+			/**
+			 * Summary of a latency histogram, in nanoseconds
+			 */
+			report& operator()(const char* key, const madag::sync::histogram_snapshot& h)
+			{
+				std::string prefix(key);
+				(*this)((prefix + "_mean").c_str(), h.mean());
+				(*this)((prefix + "_p50" ).c_str(), h.percentile(0.50));
+				(*this)((prefix + "_p99" ).c_str(), h.percentile(0.99));
+				(*this)((prefix + "_p999").c_str(), h.percentile(0.999));
+				return (*this)((prefix + "_max").c_str(), h.max);
+			}
+
+		private:
+			report& raw(const char* key, const std::string& value)
+			{
+				m_line += ",\"" + std::string(key) + "\":" + value;
+				return *this;
+			}
+
+		private:
+			std::string m_line;
+	};
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * Parallel algorithms (include/parallel.hh) against their serial std::
+ * counterparts.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude -Ibench bench/parallel.cc -o parallel -pthread
+ *   ./parallel [n]
+ *
+ * `n` (default 10000000) is the number of elements. Each result is a JSON
+ * object on its own line.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "bench.hh"
+#include "parallel.hh"
+
+using namespace madag::sync;
+
+/**
+ * Time `serial` and `parallel` on fresh copies of `input`, and check they agree
+ */
+template<class Serial, class Parallel>
+void compare(const char* name, const std::vector<std::uint64_t>& input, Serial serial, Parallel parallel)
+{
+	std::vector<std::uint64_t> expected = input;
+	auto begin = bench::clock::now();
+	serial(expected);
+	double serial_seconds = bench::seconds_since(begin);
+
+	std::vector<std::uint64_t> actual = input;
+	begin = bench::clock::now();
+	parallel(actual);
+	double parallel_seconds = bench::seconds_since(begin);
+
+	bench::report report(name);
+	report
+		("elements",     input.size())
+		("threads",      ThreadPool::shared().size() + 1)
+		("serial_sec",   serial_seconds)
+		("parallel_sec", parallel_seconds)
+		("speedup",      serial_seconds / parallel_seconds)
+		("correct",      expected == actual);
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+	std::vector<std::uint64_t> input(n);
+	std::mt19937_64 random(42);
+	for (std::uint64_t& value : input) value = random() % 1000000;
+
+	compare("for_each", input,
+		[](std::vector<std::uint64_t>& v){ std::for_each(v.begin(), v.end(), [](std::uint64_t& x){ x = std::uint64_t(std::sqrt(double(x)) * 1000.); }); },
+		[](std::vector<std::uint64_t>& v){ parallel_for(0, v.size(), [&](std::size_t i){ v[i] = std::uint64_t(std::sqrt(double(v[i])) * 1000.); }, 4096); });
+
+	compare("reduce", input,
+		[](std::vector<std::uint64_t>& v){ v.assign(1, std::accumulate(v.begin(), v.end(), std::uint64_t(0))); },
+		[](std::vector<std::uint64_t>& v){ v.assign(1, parallel_reduce(v.begin(), v.end(), std::uint64_t(0))); });
+
+	compare("scan", input,
+		[](std::vector<std::uint64_t>& v){ std::partial_sum(v.begin(), v.end(), v.begin()); },
+		[](std::vector<std::uint64_t>& v){ parallel_scan(v.begin(), v.end(), v.begin()); });
+
+	compare("sort", input,
+		[](std::vector<std::uint64_t>& v){ std::sort(v.begin(), v.end()); },
+		[](std::vector<std::uint64_t>& v){ parallel_sort(v.begin(), v.end()); });
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/**
+ * Synchronization primitives (include/primitives.hh) against the standard
+ * library ones.
+ *
+ *   g++ -std=c++20 -O2 -Iinclude -Ibench bench/primitives.cc -o primitives -pthread
+ *   ./primitives [scale]
+ *
+ * With -std=c++17 only std::mutex is available for comparison. Each result
+ * is a JSON object on its own line, latencies are in nanoseconds.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if __cplusplus >= 202002L && __has_include(<barrier>) && __has_include(<latch>) && __has_include(<semaphore>)
+#include <barrier>
+#include <latch>
+#include <semaphore>
+#define BENCH_STD20 1
+#endif
+
+#include "bench.hh"
+#include "primitives.hh"
+
+using namespace madag::sync;
+
+/**
+ * Threads incrementing a shared counter under the lock
+ */
+template<class Mutex>
+void mutex_increments(const char* name, unsigned threads, std::uint64_t increments)
+{
+	Mutex                    mutex;
+	std::uint64_t            counter = 0;
+	std::vector<std::thread> workers;
+	auto begin = bench::clock::now();
+	for (unsigned t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&]{
+			for (std::uint64_t i = 0; i < increments; ++i)
+			{
+				std::lock_guard<Mutex> lock(mutex);
+				++counter;
+			}
+		});
+	}
+	for (std::thread& worker : workers) worker.join();
+	double seconds = bench::seconds_since(begin);
+	bench::report report("mutex_increments");
+	report
+		("type",           name)
+		("threads",        threads)
+		("locks_per_sec",  counter / seconds);
+	if constexpr (std::is_same_v<Mutex, counted_futex_mutex>)
+	{
+		contention_stats stats = mutex.stats();
+		report
+			("contended", stats.contended)
+			("parks",     stats.parks);
+	}
+}
+
+/**
+ * Two threads handing a token back and forth through a pair of semaphores
+ */
+template<class Semaphore>
+void semaphore_round_trip(const char* name, std::uint64_t rounds)
+{
+	Semaphore ping(0), pong(0);
+	std::thread echo([&]{
+		for (std::uint64_t i = 0; i < rounds; ++i) { ping.acquire(); pong.release(); }
+	});
+	histogram<> latency;
+	auto begin = bench::clock::now();
+	for (std::uint64_t i = 0; i < rounds; ++i)
+	{
+		auto sent = bench::clock::now();
+		ping.release();
+		pong.acquire();
+		latency.record(bench::nanoseconds(bench::clock::now() - sent));
+	}
+	double seconds = bench::seconds_since(begin);
+	echo.join();
+	bench::report("semaphore_round_trip")
+		("type",                name)
+		("rounds",              rounds)
+		("round_trips_per_sec", rounds / seconds)
+		("latency",             latency.snapshot());
+}
+
+/**
+ * Threads going through consecutive barrier phases
+ */
+template<class Barrier>
+void barrier_phases(const char* name, unsigned threads, std::uint64_t phases)
+{
+	Barrier                  barrier(threads);
+	std::vector<std::thread> workers;
+	auto begin = bench::clock::now();
+	for (unsigned t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&]{
+			for (std::uint64_t i = 0; i < phases; ++i) barrier.arrive_and_wait();
+		});
+	}
+	for (std::thread& worker : workers) worker.join();
+	double seconds = bench::seconds_since(begin);
+	bench::report("barrier_phases")
+		("type",           name)
+		("threads",        threads)
+		("phases_per_sec", phases / seconds);
+}
+
+/**
+ * Time from the last `count_down` until every waiter is released
+ */
+template<class Latch>
+void latch_release(const char* name, unsigned threads, std::uint64_t rounds)
+{
+	histogram<> release;
+	for (std::uint64_t r = 0; r < rounds; ++r)
+	{
+		Latch                      start(threads + 1);
+		Latch                      gate(1);
+		std::atomic<std::int64_t>  last = 0;
+		std::vector<std::thread>   workers;
+		for (unsigned t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&]{
+				start.count_down();
+				gate.wait();
+				std::int64_t now = std::int64_t(bench::nanoseconds(bench::clock::now().time_since_epoch()));
+				std::int64_t seen = last.load();
+				while (seen < now && !last.compare_exchange_weak(seen, now));
+			});
+		}
+		start.arrive_and_wait();
+		auto opened = bench::clock::now();
+		gate.count_down();
+		for (std::thread& worker : workers) worker.join();
+		release.record(std::uint64_t(std::max<std::int64_t>(0, last - std::int64_t(bench::nanoseconds(opened.time_since_epoch())))));
+	}
+	bench::report("latch_release")
+		("type",    name)
+		("threads", threads)
+		("release", release.snapshot());
+}
+
+int main(int argc, char* argv[])
+{
+	std::uint64_t scale = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+	if (!scale) scale = 1;
+	unsigned hardware = std::max(2u, std::thread::hardware_concurrency());
+
+	for (unsigned threads = 1; threads <= hardware; threads *= 2)
+	{
+		mutex_increments<futex_mutex>        ("futex_mutex",         threads, 200000 * scale);
+		mutex_increments<counted_futex_mutex>("counted_futex_mutex", threads, 200000 * scale);
+		mutex_increments<std::mutex>         ("std::mutex",          threads, 200000 * scale);
+	}
+
+	semaphore_round_trip<semaphore>("semaphore", 20000 * scale);
+#ifdef BENCH_STD20
+	semaphore_round_trip<std::counting_semaphore<>>("std::counting_semaphore", 20000 * scale);
+#endif
+
+	for (unsigned threads = 2; threads <= hardware; threads *= 2)
+	{
+		barrier_phases<barrier>("barrier", threads, 10000 * scale);
+#ifdef BENCH_STD20
+		barrier_phases<std::barrier<>>("std::barrier", threads, 10000 * scale);
+#endif
+	}
+
+	latch_release<latch>("latch", hardware, 200 * scale);
+#ifdef BENCH_STD20
+	latch_release<std::latch>("std::latch", hardware, 200 * scale);
+#endif
+	return EXIT_SUCCESS;
+}
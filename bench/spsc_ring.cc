@@ -0,0 +1,110 @@
+/**
+ * spsc_ring feeding a NotifiedPulser.
+ *
+ * One producer thread pushes batches of sequence numbers, the pulser drains
+ * them in batches from `tick()`. The producer only calls `wakeup()` when the
+ * pulser announced it went idle, so the notifiable stays off the hot path.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude -Ibench bench/spsc_ring.cc -o spsc_ring -pthread
+ *   ./spsc_ring [messages] [capacity] [batch]
+ */
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "bench.hh"
+#include "queue.hh"
+#include "thread.hh"
+
+using namespace madag::sync;
+
+class Consumer : public NotifiedPulser
+{
+	public:
+		Consumer(std::size_t _capacity)
+		: ring(_capacity)
+		{
+		}
+		/**
+		 * Called by the producer after publishing a batch
+		 */
+		void published()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_idle.exchange(false)) wakeup();
+		}
+
+	public:
+		spsc_ring<std::uint64_t>   ring;
+		std::atomic<std::uint64_t> received = 0;
+		std::atomic<bool>          corrupted = false;
+
+	private:
+		void tick() final
+		{
+			std::array<std::uint64_t, 256> batch;
+			for (;;)
+			{
+				while (std::size_t n = ring.try_pop_n(batch.begin(), batch.size()))
+				{
+					for (std::size_t i = 0; i < n; ++i)
+					{
+						if (batch[i] != m_expected++) corrupted = true;
+					}
+					received.fetch_add(n, std::memory_order_release);
+				}
+				m_idle.store(true);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (ring.empty() || m_interrupted) return;
+				m_idle.store(false);
+			}
+		}
+
+	private:
+		std::atomic<bool> m_idle = true;
+		std::uint64_t     m_expected = 0;
+};
+
+int main(int argc, char* argv[])
+{
+	std::uint64_t messages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000;
+	std::size_t   capacity = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4096;
+	std::size_t   batch    = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 64;
+
+	Consumer consumer(capacity);
+	consumer.start();
+
+	std::vector<std::uint64_t> chunk(batch);
+	auto begin = bench::clock::now();
+	for (std::uint64_t sent = 0; sent < messages;)
+	{
+		std::size_t want = std::min<std::uint64_t>(batch, messages - sent);
+		for (std::size_t i = 0; i < want; ++i) chunk[i] = sent + i;
+		std::size_t done = 0;
+		while (done < want)
+		{
+			std::size_t n = consumer.ring.try_push_n(chunk.begin() + done, want - done);
+			if (n) consumer.published();
+			done += n;
+		}
+		sent += want;
+	}
+	while (consumer.received.load(std::memory_order_acquire) < messages);
+	double seconds = bench::seconds_since(begin);
+
+	consumer.kill();
+	consumer.join();
+
+	bench::report("spsc_ring_pulser")
+		("messages",     messages)
+		("capacity",     consumer.ring.capacity())
+		("batch",        batch)
+		("seconds",      seconds)
+		("msgs_per_sec", messages / seconds)
+		("ok",           !consumer.corrupted);
+	return consumer.corrupted ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,268 @@
+/**
+ * Benchmarks for the madag::sync hot paths (include/thread.hh).
+ *
+ *   g++ -std=c++17 -O2 -Iinclude -Ibench bench/sync.cc -o sync -pthread
+ *   ./sync [scale]
+ *
+ * `scale` (default 1) multiplies iteration counts and run durations, use a
+ * large value to observe ClockPulser drift over long runs. Each result is a
+ * JSON object on its own line, latencies are in nanoseconds. The exit status
+ * is a failure when an interrupted pulser did not stop, or ticked without a
+ * wakeup after a restart.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "bench.hh"
+#include "thread.hh"
+
+using namespace madag::sync;
+using namespace std::chrono_literals;
+
+/**
+ * Two threads bouncing a notification back and forth
+ */
+void notifiable_round_trip(std::uint64_t rounds)
+{
+	notifiable ping, pong;
+	std::thread echo([&]{
+		for (std::uint64_t i = 0; i < rounds; ++i) { ping.wait(); pong.notify(); }
+	});
+	histogram<> latency;
+	auto begin = bench::clock::now();
+	for (std::uint64_t i = 0; i < rounds; ++i)
+	{
+		auto sent = bench::clock::now();
+		ping.notify();
+		pong.wait();
+		latency.record(bench::nanoseconds(bench::clock::now() - sent));
+	}
+	double seconds = bench::seconds_since(begin);
+	echo.join();
+	bench::report("notifiable_round_trip")
+		("rounds",              rounds)
+		("round_trips_per_sec", rounds / seconds)
+		("latency",             latency.snapshot());
+}
+
+/**
+ * Producers hammering `wakeup()` on a NotifiedPulser
+ */
+class Counter : public NotifiedPulser
+{
+	public:
+		std::atomic<std::uint64_t> ticks = 0;
+	private:
+		void tick() final { ticks.fetch_add(1, std::memory_order_relaxed); }
+};
+
+void notified_pulser_wakeups(unsigned producers, std::chrono::milliseconds duration)
+{
+	Counter pulser;
+	pulser.start();
+	std::atomic<bool>          stop    = false;
+	std::atomic<std::uint64_t> wakeups = 0;
+	std::vector<std::thread>   threads;
+	auto begin = bench::clock::now();
+	for (unsigned p = 0; p < producers; ++p)
+	{
+		threads.emplace_back([&]{
+			std::uint64_t local = 0;
+			while (!stop.load(std::memory_order_relaxed)) { pulser.wakeup(); ++local; }
+			wakeups.fetch_add(local);
+		});
+	}
+	std::this_thread::sleep_for(duration);
+	stop = true;
+	for (std::thread& thread : threads) thread.join();
+	double seconds = bench::seconds_since(begin);
+	pulser.kill();
+	pulser.join();
+	bench::report("notified_pulser_wakeups")
+		("producers",       producers)
+		("wakeups_per_sec", wakeups / seconds)
+		("ticks_per_sec",   pulser.ticks / seconds)
+		("coalescing",      pulser.ticks ? double(wakeups) / double(pulser.ticks) : 0.);
+}
+
+/**
+ * Tick timestamps of a ClockPulser compared to the ideal schedule
+ */
+class Recorder : public ClockPulser<std::chrono::microseconds>
+{
+	public:
+		Recorder(std::chrono::microseconds _interval, std::size_t _expected)
+		: ClockPulser(_interval)
+		{
+			stamps.reserve(_expected);
+		}
+		std::vector<bench::clock::time_point> stamps;
+	private:
+		void tick() final { stamps.push_back(bench::clock::now()); }
+};
+
+void clock_pulser_accuracy(std::chrono::microseconds interval, std::chrono::milliseconds duration)
+{
+	Recorder pulser(interval, std::size_t(duration / interval) + 16);
+	auto begin = bench::clock::now();
+	pulser.start();
+	std::this_thread::sleep_for(duration);
+	pulser.interrupt();
+	pulser.join();
+
+	histogram<> period_error;
+	for (std::size_t i = 1; i < pulser.stamps.size(); ++i)
+	{
+		auto period = pulser.stamps[i] - pulser.stamps[i - 1];
+		period_error.record(bench::nanoseconds(period > interval ? period - interval : interval - period));
+	}
+	std::size_t ticks = pulser.stamps.size();
+	double ideal  = std::chrono::duration<double>(interval).count() * double(ticks);
+	double actual = ticks ? std::chrono::duration<double>(pulser.stamps.back() - begin).count() : 0.;
+	bench::report("clock_pulser_accuracy")
+		("interval_ns",       bench::nanoseconds(interval))
+		("ticks",             ticks)
+		("drift_sec",         actual - ideal)
+		("drift_per_tick_ns", ticks ? (actual - ideal) / double(ticks) * 1e9 : 0.)
+		("period_error",      period_error.snapshot());
+}
+
+/**
+ * Cost of scheduling timers, and how late they fire when many are pending
+ */
+void self_deleting_timers(std::uint64_t timers, std::chrono::milliseconds delay)
+{
+	using Timer = SelfDeletingTimer<std::chrono::milliseconds>;
+	histogram<>                lateness;
+	std::atomic<std::uint64_t> fired = 0;
+	histogram<>                creation;
+	auto begin = bench::clock::now();
+	for (std::uint64_t i = 0; i < timers; ++i)
+	{
+		auto created = bench::clock::now();
+		auto due     = created + delay;
+		Timer::factory(delay, [&, due]{
+			lateness.record(bench::nanoseconds(bench::clock::now() - due));
+			fired.fetch_add(1, std::memory_order_release);
+		})->start();
+		creation.record(bench::nanoseconds(bench::clock::now() - created));
+	}
+	double scheduling = bench::seconds_since(begin);
+	while (fired.load(std::memory_order_acquire) < timers) std::this_thread::sleep_for(1ms);
+	std::this_thread::sleep_for(10ms); // let the last timers delete themselves
+	bench::report("self_deleting_timers")
+		("timers",         timers)
+		("delay_ns",       bench::nanoseconds(delay))
+		("timers_per_sec", timers / scheduling)
+		("creation",       creation.snapshot())
+		("fire_lateness",  lateness.snapshot());
+}
+
+/**
+ * Interrupting a throttled pulser while producers keep notifying: it must
+ * stop even when a throttling mode consumed the interrupt's notification
+ */
+class Throttled : public DelayedNotifiedPulser<std::chrono::microseconds>
+{
+	public:
+		using DelayedNotifiedPulser::DelayedNotifiedPulser;
+		std::atomic<std::uint64_t> ticks = 0;
+	private:
+		void tick() final { ticks.fetch_add(1, std::memory_order_relaxed); }
+};
+
+bool throttled_pulser_interrupt(const char* mode, const throttle<std::chrono::microseconds>& config, unsigned rounds)
+{
+	histogram<> stop_latency;
+	for (unsigned round = 0; round < rounds; ++round)
+	{
+		auto pulser = new Throttled(config); // leaked if it never stops, its thread still uses it
+		pulser->start();
+		auto until = bench::clock::now() + std::chrono::microseconds(50 + 37 * round % 200);
+		while (bench::clock::now() < until) pulser->wakeup();
+		auto interrupted = bench::clock::now();
+		pulser->interrupt(); // last notification the pulser gets
+		while (!pulser->finished() && bench::clock::now() - interrupted < 1s) std::this_thread::sleep_for(100us);
+		if (!pulser->finished())
+		{
+			bench::report("throttled_pulser_interrupt")("mode", mode)("stuck_round", round);
+			pulser->detach();
+			return false;
+		}
+		stop_latency.record(bench::nanoseconds(bench::clock::now() - interrupted));
+		pulser->join();
+		delete pulser;
+	}
+	bench::report("throttled_pulser_interrupt")
+		("mode",         mode)
+		("rounds",       rounds)
+		("stop_latency", stop_latency.snapshot());
+	return true;
+}
+
+/**
+ * Restarting a pulser interrupted during its post-tick delay: it must not
+ * tick again before a new wakeup
+ */
+bool throttled_pulser_restart(const char* mode, const throttle<std::chrono::microseconds>& config, unsigned rounds)
+{
+	Throttled pulser(config);
+	std::uint64_t spurious = 0;
+	for (unsigned round = 0; round < rounds; ++round)
+	{
+		pulser.start();
+		std::uint64_t before = pulser.ticks.load();
+		pulser.wakeup();
+		while (pulser.ticks.load() == before) std::this_thread::yield();
+		pulser.interrupt(); // within the delay following the tick
+		pulser.join();
+		std::uint64_t stopped = pulser.ticks.load();
+		pulser.start();
+		std::this_thread::sleep_for(2ms);
+		pulser.interrupt();
+		pulser.join();
+		spurious += pulser.ticks.load() - stopped;
+	}
+	bench::report("throttled_pulser_restart")
+		("mode",     mode)
+		("rounds",   rounds)
+		("spurious", spurious);
+	return !spurious;
+}
+
+int main(int argc, char* argv[])
+{
+	std::uint64_t scale = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+	if (!scale) scale = 1;
+
+	notifiable_round_trip(20000 * scale);
+
+	unsigned hardware = std::max(2u, std::thread::hardware_concurrency());
+	for (unsigned producers = 1; producers <= hardware; producers *= 2)
+	{
+		notified_pulser_wakeups(producers, std::chrono::milliseconds(200 * scale));
+	}
+
+	clock_pulser_accuracy(1000us, std::chrono::milliseconds(1000 * scale));
+	clock_pulser_accuracy(100us,  std::chrono::milliseconds(1000 * scale));
+
+	self_deleting_timers(100  * scale, 50ms);
+	self_deleting_timers(1000 * scale, 50ms);
+
+	using throttle = madag::sync::throttle<std::chrono::microseconds>;
+	bool stopped = true;
+	stopped &= throttled_pulser_interrupt("fixed_delay",       throttle::fixed_delay(20us),             1000 * unsigned(scale));
+	stopped &= throttled_pulser_interrupt("token_bucket",      throttle::token_bucket(20us, 4),         1000 * unsigned(scale));
+	stopped &= throttled_pulser_interrupt("debounce_leading",  throttle::debounce_leading(20us),        1000 * unsigned(scale));
+	stopped &= throttled_pulser_interrupt("debounce_trailing", throttle::debounce_trailing(20us, 80us), 1000 * unsigned(scale));
+	stopped &= throttled_pulser_interrupt("coalesce",          throttle::coalesce(20us),                1000 * unsigned(scale));
+	stopped &= throttled_pulser_restart("fixed_delay",       throttle::fixed_delay(50ms),             20 * unsigned(scale));
+	stopped &= throttled_pulser_restart("debounce_leading",  throttle::debounce_leading(50ms),        20 * unsigned(scale));
+	stopped &= throttled_pulser_restart("debounce_trailing", throttle::debounce_trailing(1us, 1us),   20 * unsigned(scale));
+	stopped &= throttled_pulser_restart("coalesce",          throttle::coalesce(50ms),                20 * unsigned(scale));
+	return stopped ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,225 @@
+/**
+ * UnionFind benchmarks across workloads and containers.
+ *
+ *   g++ -std=c++17 -O2 -Iinclude -Ibench bench/unionfind.cc -o unionfind
+ *   ./unionfind [nodes]
+ *
+ * For every workload the edges are merged, then every node is looked up
+ * once. Each line reports merge and find throughput, the peak number of
+ * bytes held by the container, and the average number of links between a
+ * node and its root once all edges are merged (before the find pass
+ * compresses the paths).
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bench.hh"
+#include "unionfind.hh"
+
+using key   = std::uint64_t;
+using edges = std::vector<std::pair<key, key>>;
+
+/**
+ * Allocator keeping track of the bytes currently held and their peak
+ */
+struct memory
+{
+	static inline std::size_t current = 0;
+	static inline std::size_t peak    = 0;
+	static void reset() { current = peak = 0; }
+};
+
+template<class T>
+struct counting_allocator
+{
+	using value_type = T;
+	counting_allocator() = default;
+	template<class U> counting_allocator(const counting_allocator<U>&) {}
+	T* allocate(std::size_t n)
+	{
+		memory::current += n * sizeof(T);
+		memory::peak     = std::max(memory::peak, memory::current);
+		return std::allocator<T>().allocate(n);
+	}
+	void deallocate(T* p, std::size_t n)
+	{
+		memory::current -= n * sizeof(T);
+		std::allocator<T>().deallocate(p, n);
+	}
+	template<class U> bool operator==(const counting_allocator<U>&) const { return true;  }
+	template<class U> bool operator!=(const counting_allocator<U>&) const { return false; }
+};
+
+using hashed = std::unordered_map<key, key, std::hash<key>, std::equal_to<key>, counting_allocator<std::pair<const key, key>>>;
+using sorted = std::map<key, key, std::less<key>, counting_allocator<std::pair<const key, key>>>;
+using dense  = DenseMapping<key, counting_allocator<key>>;
+
+/***************************************************************************/
+/*                                Workloads                                */
+/***************************************************************************/
+struct workload
+{
+	const char*      name;
+	std::vector<key> nodes;
+	edges            links;
+	bool             dense; // keys in [0, nodes.size())
+};
+
+std::vector<key> iota(std::size_t n)
+{
+	std::vector<key> nodes(n);
+	for (std::size_t i = 0; i < n; ++i) nodes[i] = i;
+	return nodes;
+}
+
+workload random_graph(std::size_t n, std::mt19937_64& rng)
+{
+	std::uniform_int_distribution<key> pick(0, n - 1);
+	edges links(2 * n);
+	for (auto& link : links) link = { pick(rng), pick(rng) };
+	return { "random", iota(n), std::move(links), true };
+}
+
+workload grid_graph(std::size_t n, std::mt19937_64&)
+{
+	std::size_t side = std::size_t(std::sqrt(double(n)));
+	edges links;
+	for (std::size_t y = 0; y < side; ++y)
+	for (std::size_t x = 0; x < side; ++x)
+	{
+		if (x + 1 < side) links.emplace_back(y * side + x, y * side + x + 1);
+		if (y + 1 < side) links.emplace_back(y * side + x, (y + 1) * side + x);
+	}
+	return { "grid", iota(side * side), std::move(links), true };
+}
+
+/**
+ * Preferential attachment: each new node links to two endpoints of
+ * existing edges, giving a power-law degree distribution
+ */
+workload power_law_graph(std::size_t n, std::mt19937_64& rng)
+{
+	edges links = { { 0, 1 } };
+	for (key node = 2; node < n; ++node)
+	{
+		for (int k = 0; k < 2; ++k)
+		{
+			const auto& target = links[std::uniform_int_distribution<std::size_t>(0, links.size() - 1)(rng)];
+			links.emplace_back(node, rng() & 1 ? target.first : target.second);
+		}
+	}
+	return { "power_law", iota(n), std::move(links), true };
+}
+
+/**
+ * Every merge puts the previous root below the new node, building a single
+ * path that `find` has to walk (recursively) from the far end. Kept short
+ * enough not to overflow the stack.
+ */
+workload long_chain(std::size_t n, std::mt19937_64&)
+{
+	n = std::min<std::size_t>(n, 20000);
+	edges links;
+	for (key node = 1; node < n; ++node) links.emplace_back(node, node - 1);
+	return { "long_chain", iota(n), std::move(links), true };
+}
+
+workload sparse_keys(std::size_t n, std::mt19937_64& rng)
+{
+	std::vector<key> nodes(n);
+	for (auto& node : nodes) node = rng();
+	std::uniform_int_distribution<std::size_t> pick(0, n - 1);
+	edges links(2 * n);
+	for (auto& link : links) link = { nodes[pick(rng)], nodes[pick(rng)] };
+	return { "sparse_keys", std::move(nodes), std::move(links), false };
+}
+
+/***************************************************************************/
+/*                                  Runner                                 */
+/***************************************************************************/
+/**
+ * Sum of the depths of `nodes`, each path walked once: a node's depth is
+ * memoized as one more than its father's
+ */
+template<class Container>
+double total_depth(const UnionFind<key, Container>& uf, const std::vector<key>& nodes)
+{
+	std::unordered_map<key, std::size_t> depths;
+	std::vector<key> path;
+	double total = 0;
+	for (key node : nodes)
+	{
+		key current = node;
+		auto known  = depths.find(current);
+		while (known == depths.end() && uf.parent(current) != current)
+		{
+			path.push_back(current);
+			current = uf.parent(current);
+			known   = depths.find(current);
+		}
+		std::size_t depth = known == depths.end() ? 0 : known->second;
+		if (known == depths.end()) depths.emplace(current, 0);
+		while (!path.empty())
+		{
+			depths.emplace(path.back(), ++depth);
+			path.pop_back();
+		}
+		total += double(depths[node]);
+	}
+	return total;
+}
+
+template<class Container>
+void run(const workload& w, const char* container)
+{
+	memory::reset();
+	{
+		UnionFind<key, Container> uf;
+
+		auto begin = bench::clock::now();
+		for (const auto& [a, b] : w.links) uf.merge(a, b);
+		double merging = bench::seconds_since(begin);
+
+		double links = total_depth(uf, w.nodes);
+
+		begin = bench::clock::now();
+		key checksum = 0;
+		for (key node : w.nodes) checksum ^= uf.find(node);
+		double finding = bench::seconds_since(begin);
+
+		bench::report("unionfind")
+			("workload",       w.name)
+			("container",      container)
+			("nodes",          w.nodes.size())
+			("edges",          w.links.size())
+			("merges_per_sec", double(w.links.size()) / merging)
+			("finds_per_sec",  double(w.nodes.size()) / finding)
+			("ops_per_sec",    double(w.links.size() + w.nodes.size()) / (merging + finding))
+			("peak_bytes",     memory::peak)
+			("avg_path",       links / double(w.nodes.size()))
+			("checksum",       checksum);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000;
+	std::mt19937_64 rng(42);
+
+	for (auto generate : { random_graph, grid_graph, power_law_graph, long_chain, sparse_keys })
+	{
+		workload w = generate(n, rng);
+		run<hashed>(w, "unordered_map");
+		run<sorted>(w, "map");
+		if (w.dense) run<dense>(w, "dense");
+	}
+	return EXIT_SUCCESS;
+}
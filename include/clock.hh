@@ -0,0 +1,314 @@
+#ifndef CLOCK_HH
+#define CLOCK_HH
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                              Clock policies                             */
+	/***************************************************************************/
+	/**
+	 * Time source used by the sleeping pulsers and timers. A policy provides
+	 * `now()`, `sleep_for(duration)` and `sleep_until(time_point)`, plus
+	 * overloads of both sleeps taking an `interrupter`, which return early
+	 * (and false) once it is raised.
+	 */
+
+	/**
+	 * Cuts short the sleeps started with it, until `reset`
+	 */
+	class interrupter
+	{
+		public:
+			void raise()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_raised.store(true);
+					m_condition.notify_all();
+				}
+				if (auto poke = m_poke.load()) poke();
+			}
+			bool raised() const
+			{
+				return m_raised.load();
+			}
+			void reset()
+			{
+				m_raised.store(false);
+			}
+
+		private:
+			friend struct steady_sleeper;
+			friend class  virtual_clock;
+			std::mutex              m_mutex;
+			std::condition_variable m_condition;
+			std::atomic<bool>       m_raised = false;
+			std::atomic<void(*)()>  m_poke   = nullptr; // wakes sleepers waiting elsewhere
+	};
+
+	/**
+	 * Real time, sleeping the calling thread (default)
+	 */
+	struct steady_sleeper
+	{
+		using clock      = std::chrono::steady_clock;
+		using duration   = clock::duration;
+		using time_point = clock::time_point;
+
+		static time_point now()
+		{
+			return clock::now();
+		}
+		template<class Rep, class Period>
+		static void sleep_for(const std::chrono::duration<Rep, Period>& d)
+		{
+			std::this_thread::sleep_for(d);
+		}
+		static void sleep_until(const time_point& t)
+		{
+			std::this_thread::sleep_until(t);
+		}
+		template<class Rep, class Period>
+		static bool sleep_for(const std::chrono::duration<Rep, Period>& d, interrupter& i)
+		{
+			return sleep_until(now() + std::chrono::duration_cast<duration>(d), i);
+		}
+		static bool sleep_until(const time_point& t, interrupter& i)
+		{
+			std::unique_lock<std::mutex> lock(i.m_mutex);
+			return !i.m_condition.wait_until(lock, t, [&]{ return i.raised(); });
+		}
+	};
+
+	/**
+	 * Manually driven time for tests.
+	 *
+	 * Time only moves when `advance`/`advance_to` is called, or, with
+	 * `auto_advance(true)`, as soon as every thread that slept on this clock
+	 * is sleeping again (or has exited): the clock then jumps straight to the
+	 * earliest deadline. Enable it once the threads under test went to sleep
+	 * (see `wait_idle`), a thread that never slept yet is not waited for.
+	 * `wait_idle(n)` blocks until `n` threads sleep on a deadline still in
+	 * the future, which is the point where a test can advance time
+	 * deterministically.
+	 *
+	 * A thread blocked on something else, such as a `notifiable`, should
+	 * not hold automatic advance back. `park()` stops counting it as awake
+	 * while it blocks. Whoever wakes it calls `hand_over()` before the
+	 * wakeup, so time cannot jump between the wakeup and the thread running
+	 * again, and the woken thread then calls `unpark(true)`.
+	 *
+	 * The clock is global: tests sharing it must not run concurrently.
+	 */
+	class virtual_clock
+	{
+		public:
+			using clock      = virtual_clock;
+			using duration   = std::chrono::nanoseconds;
+			using rep        = duration::rep;
+			using period     = duration::period;
+			using time_point = std::chrono::time_point<virtual_clock>;
+			static constexpr bool is_steady = true;
+
+		public:
+			static time_point now()
+			{
+				std::lock_guard<std::mutex> lock(state().mutex);
+				return state().now;
+			}
+			template<class Rep, class Period>
+			static void sleep_for(const std::chrono::duration<Rep, Period>& d)
+			{
+				sleep_until(now() + std::chrono::duration_cast<duration>(d));
+			}
+			static void sleep_until(const time_point& t)
+			{
+				wait_until(t, nullptr);
+			}
+			template<class Rep, class Period>
+			static bool sleep_for(const std::chrono::duration<Rep, Period>& d, interrupter& i)
+			{
+				return sleep_until(now() + std::chrono::duration_cast<duration>(d), i);
+			}
+			static bool sleep_until(const time_point& t, interrupter& i)
+			{
+				i.m_poke.store(&poke);
+				return wait_until(t, &i);
+			}
+			template<class Rep, class Period>
+			static void advance(const std::chrono::duration<Rep, Period>& d)
+			{
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				s.now += std::chrono::duration_cast<duration>(d);
+				s.changed.notify_all();
+			}
+			static void advance_to(const time_point& t)
+			{
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				if (t > s.now) s.now = t;
+				s.changed.notify_all();
+			}
+			/**
+			 * Jump to the earliest deadline whenever no thread is awake
+			 */
+			static void auto_advance(bool enabled)
+			{
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				s.automatic = enabled;
+				s.changed.notify_all();
+			}
+			/**
+			 * Block until `threads` threads sleep on a deadline in the future
+			 */
+			static void wait_idle(std::size_t threads)
+			{
+				shared& s = state();
+				std::unique_lock<std::mutex> lock(s.mutex);
+				while (idle(s) < threads) s.changed.wait(lock);
+			}
+			static std::size_t sleepers()
+			{
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				return idle(s);
+			}
+			/**
+			 * The calling thread is about to block outside the clock. Returns
+			 * whether it counted as awake (and must `unpark` afterwards).
+			 */
+			static bool park()
+			{
+				sleeper& self = local();
+				if (!self.awake) return false;
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				self.awake = false;
+				--s.awake;
+				s.changed.notify_all();
+				return true;
+			}
+			/**
+			 * Count a parked thread as awake again, on its behalf
+			 */
+			static void hand_over()
+			{
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				++s.awake;
+			}
+			/**
+			 * The calling thread stopped blocking after `park()` returned
+			 * true. `handed` tells whether a waker already counted it.
+			 */
+			static void unpark(bool handed)
+			{
+				sleeper& self = local();
+				self.awake = true;
+				if (handed) return;
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				++s.awake;
+			}
+			/**
+			 * Back to the epoch, without automatic advance. No thread may be
+			 * sleeping.
+			 */
+			static void reset()
+			{
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				s.now       = time_point();
+				s.automatic = false;
+			}
+
+		private:
+			/**
+			 * Sleep until `t`, or until `i` (if any) is raised
+			 */
+			static bool wait_until(const time_point& t, interrupter* i)
+			{
+				shared& s = state();
+				sleeper& self = local();
+				std::unique_lock<std::mutex> lock(s.mutex);
+				if (self.awake) { self.awake = false; --s.awake; }
+				auto deadline = s.deadlines.insert(t);
+				s.changed.notify_all();
+				while (s.now < t && !(i && i->raised()))
+				{
+					if (s.automatic && !s.awake && s.now < *s.deadlines.begin())
+					{
+						s.now = *s.deadlines.begin();
+						s.changed.notify_all();
+						continue;
+					}
+					s.changed.wait(lock);
+				}
+				s.deadlines.erase(deadline);
+				self.awake = true;
+				++s.awake;
+				return s.now >= t;
+			}
+			static void poke()
+			{
+				shared& s = state();
+				std::lock_guard<std::mutex> lock(s.mutex);
+				s.changed.notify_all();
+			}
+
+		private:
+			struct shared
+			{
+				std::mutex                mutex;
+				std::condition_variable   changed;
+				time_point                now;
+				std::multiset<time_point> deadlines;
+				std::size_t               awake     = 0; // threads woken up and not sleeping again yet
+				bool                      automatic = false;
+			};
+			/**
+			 * Per thread: woken up by the clock, not sleeping again yet
+			 */
+			struct sleeper
+			{
+				bool awake = false;
+				~sleeper()
+				{
+					if (!awake) return;
+					shared& s = state();
+					std::lock_guard<std::mutex> lock(s.mutex);
+					--s.awake;
+					s.changed.notify_all();
+				}
+			};
+			static shared& state()
+			{
+				static shared global;
+				return global;
+			}
+			static sleeper& local()
+			{
+				thread_local sleeper self;
+				return self;
+			}
+			static std::size_t idle(const shared& s)
+			{
+				return std::size_t(std::distance(s.deadlines.upper_bound(s.now), s.deadlines.end()));
+			}
+	};
+
+}
+
+#endif
@@ -0,0 +1,440 @@
+#ifndef COROUTINE_HH
+#define COROUTINE_HH
+
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "queue.hh"
+#include "thread.hh"
+
+/**
+ * Coroutine pulsers (C++20).
+ *
+ * Periodic or notified logic is written as a coroutine returning `task`,
+ * suspending on `sleep_for`, `next_tick` or `notified`. Tasks are spawned on a
+ * `scheduler` which multiplexes them on a few worker threads plus one timer
+ * thread, so each task costs its coroutine frame (usually a few hundred
+ * bytes) instead of a thread.
+ *
+ *   coro::task blink(coro::event& e)
+ *   {
+ *       for (;;)
+ *       {
+ *           co_await coro::next_tick(std::chrono::milliseconds(100));
+ *           co_await coro::notified(e);
+ *       }
+ *   }
+ *   coro::scheduler s(4);
+ *   s.spawn(blink(e));
+ */
+namespace madag::sync::coro
+{
+
+	class scheduler;
+	using clock = std::chrono::steady_clock;
+
+	/***************************************************************************/
+	/*                                   Task                                  */
+	/***************************************************************************/
+	/**
+	 * Fire and forget coroutine. It starts once spawned and its frame is
+	 * released when it returns (or when its scheduler shuts down). An
+	 * exception escaping it ends the task and is kept by the scheduler, see
+	 * `scheduler::rethrow`.
+	 */
+	class task
+	{
+		public:
+			struct promise_type
+			{
+				scheduler*        owner = nullptr;
+				clock::time_point next_tick;
+				promise_type*     prev  = nullptr; // live tasks of `owner`
+				promise_type*     next  = nullptr;
+
+				task get_return_object()
+				{
+					return task(std::coroutine_handle<promise_type>::from_promise(*this));
+				}
+				std::suspend_always initial_suspend() noexcept { return {}; }
+				std::suspend_never  final_suspend  () noexcept { return {}; }
+				void return_void() {}
+				void unhandled_exception();
+				~promise_type();
+			};
+			using handle = std::coroutine_handle<promise_type>;
+
+		public:
+			task(task&& other) : m_handle(std::exchange(other.m_handle, nullptr)) {}
+			task(const task&) = delete;
+			task& operator=(const task&) = delete;
+			task& operator=(task&&) = delete;
+			~task()
+			{
+				if (m_handle) m_handle.destroy(); // never spawned
+			}
+
+		private:
+			friend class scheduler;
+			explicit task(handle _handle) : m_handle(_handle) {}
+			handle release() { return std::exchange(m_handle, nullptr); }
+
+		private:
+			handle m_handle;
+	};
+
+	/***************************************************************************/
+	/*                                Scheduler                                */
+	/***************************************************************************/
+	/**
+	 * Runs ready tasks on `threads` workers. The ready queue holds at most one
+	 * entry per live task, so `max_tasks` bounds how many tasks may be alive
+	 * at once without resumptions blocking.
+	 */
+	class scheduler
+	{
+		public:
+			scheduler(std::size_t threads = std::thread::hardware_concurrency(), std::size_t max_tasks = 1 << 16)
+			: m_ready(max_tasks)
+			, m_timer(*this)
+			{
+				if (!threads) threads = 1;
+				for (std::size_t i = 0; i < threads; ++i)
+				{
+					m_workers.push_back(std::make_unique<worker>(*this));
+					m_workers.back()->start();
+				}
+				m_timer.start();
+			}
+			scheduler(const scheduler&) = delete;
+			scheduler& operator=(const scheduler&) = delete;
+			~scheduler()
+			{
+				shutdown();
+			}
+
+			/**
+			 * Start `t`. Once shut down, the task is destroyed without running
+			 * and false is returned.
+			 */
+			bool spawn(task&& t)
+			{
+				task::handle h = t.release();
+				{
+					std::unique_lock<std::mutex> lock(m_tasks_mutex);
+					if (m_stopped) // checked under the lock `shutdown` releases the frames with
+					{
+						lock.unlock();
+						h.destroy();
+						return false;
+					}
+					promise_type& p = h.promise();
+					p.owner = this;
+					p.next  = m_tasks;
+					if (m_tasks) m_tasks->prev = &p;
+					m_tasks = &p;
+					++m_count;
+				}
+				schedule(h);
+				return true;
+			}
+			std::size_t tasks() const
+			{
+				std::lock_guard<std::mutex> lock(m_tasks_mutex);
+				return m_count;
+			}
+			/**
+			 * Stop the threads and destroy the frames of unfinished tasks.
+			 * Events must not be notified afterwards.
+			 */
+			void shutdown()
+			{
+				if (m_stopped.exchange(true)) return;
+				m_ready.close();
+				m_timer.interrupt();
+				for (auto& w : m_workers) w->join();
+				m_timer.join();
+				std::lock_guard<std::mutex> lock(m_tasks_mutex);
+				while (m_tasks)
+				{
+					promise_type* p = m_tasks;
+					m_tasks = p->next;
+					p->owner = nullptr;
+					task::handle::from_promise(*p).destroy();
+				}
+				m_count = 0;
+			}
+			/**
+			 * Rethrow the first exception that escaped a task since the last
+			 * call, if any
+			 */
+			void rethrow()
+			{
+				std::exception_ptr error;
+				{
+					std::lock_guard<std::mutex> lock(m_tasks_mutex);
+					error = std::exchange(m_error, nullptr);
+				}
+				if (error) std::rethrow_exception(error);
+			}
+
+		private:
+			using promise_type = task::promise_type;
+			friend promise_type;
+			friend class sleep_awaiter;
+			friend class tick_awaiter;
+			friend class event;
+
+			void schedule(std::coroutine_handle<> h)
+			{
+				m_ready.push(h); // false once shut down, the frame is destroyed there
+			}
+			void wake_at(clock::time_point deadline, std::coroutine_handle<> h)
+			{
+				m_timer.add(deadline, h);
+			}
+			void forget(promise_type* p)
+			{
+				std::lock_guard<std::mutex> lock(m_tasks_mutex);
+				if (p->prev) p->prev->next = p->next;
+				else         m_tasks       = p->next;
+				if (p->next) p->next->prev = p->prev;
+				--m_count;
+			}
+			void failed(std::exception_ptr error)
+			{
+				std::lock_guard<std::mutex> lock(m_tasks_mutex);
+				if (!m_error) m_error = std::move(error);
+			}
+
+			class worker : public PolymorphicThread<>
+			{
+				public:
+					worker(scheduler& _owner) : m_owner(_owner) {}
+				private:
+					void run() final
+					{
+						std::coroutine_handle<> h;
+						while (m_owner.m_ready.pop(h)) h.resume();
+					}
+				private:
+					scheduler& m_owner;
+			};
+
+			/**
+			 * Sleeps until the earliest deadline, then hands due tasks to the
+			 * workers
+			 */
+			class timer : public PolymorphicThread<>
+			{
+				public:
+					timer(scheduler& _owner) : m_owner(_owner) {}
+					void add(clock::time_point deadline, std::coroutine_handle<> h)
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						bool earliest = m_deadlines.empty() || deadline < m_deadlines.top().first;
+						m_deadlines.emplace(deadline, h);
+						if (earliest) m_condition.notify_one();
+					}
+					void interrupt()
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_interrupted = true;
+						m_condition.notify_one();
+					}
+				private:
+					void run() final
+					{
+						std::vector<std::coroutine_handle<>> due;
+						std::unique_lock<std::mutex> lock(m_mutex);
+						while (!m_interrupted)
+						{
+							if (m_deadlines.empty())
+							{
+								m_condition.wait(lock);
+								continue;
+							}
+							clock::time_point now = clock::now();
+							while (!m_deadlines.empty() && m_deadlines.top().first <= now)
+							{
+								due.push_back(m_deadlines.top().second);
+								m_deadlines.pop();
+							}
+							if (due.empty())
+							{
+								clock::time_point next = m_deadlines.top().first; // the heap may grow while waiting
+								m_condition.wait_until(lock, next);
+								continue;
+							}
+							lock.unlock();
+							for (std::coroutine_handle<> h : due) m_owner.schedule(h);
+							due.clear();
+							lock.lock();
+						}
+					}
+				private:
+					using entry = std::pair<clock::time_point, std::coroutine_handle<>>;
+					struct later
+					{
+						bool operator()(const entry& a, const entry& b) const { return a.first > b.first; }
+					};
+					scheduler&                                           m_owner;
+					std::mutex                                           m_mutex;
+					std::condition_variable                              m_condition;
+					std::priority_queue<entry, std::vector<entry>, later> m_deadlines;
+					bool                                                 m_interrupted = false;
+			};
+
+		private:
+			mpmc_queue<std::coroutine_handle<>>  m_ready;
+			std::vector<std::unique_ptr<worker>> m_workers;
+			timer                                m_timer;
+			mutable std::mutex                   m_tasks_mutex;
+			promise_type*                        m_tasks = nullptr;
+			std::size_t                          m_count = 0;
+			std::exception_ptr                   m_error;   // guarded by m_tasks_mutex
+			std::atomic<bool>                    m_stopped = false;
+	};
+
+	inline void task::promise_type::unhandled_exception()
+	{
+		owner->failed(std::current_exception()); // tasks only run once spawned
+	}
+
+	inline task::promise_type::~promise_type()
+	{
+		if (owner) owner->forget(this);
+	}
+
+	/***************************************************************************/
+	/*                                Awaitables                               */
+	/***************************************************************************/
+	class sleep_awaiter
+	{
+		public:
+			explicit sleep_awaiter(clock::duration _delay) : m_delay(_delay) {}
+			bool await_ready() const { return m_delay <= clock::duration::zero(); }
+			void await_suspend(task::handle h) const
+			{
+				h.promise().owner->wake_at(clock::now() + m_delay, h);
+			}
+			void await_resume() const {}
+		private:
+			clock::duration m_delay;
+	};
+
+	/**
+	 * Resume after `delay`
+	 */
+	template<class Rep, class Period>
+	sleep_awaiter sleep_for(const std::chrono::duration<Rep, Period>& delay)
+	{
+		return sleep_awaiter(std::chrono::duration_cast<clock::duration>(delay));
+	}
+
+	class tick_awaiter
+	{
+		public:
+			explicit tick_awaiter(clock::duration _period) : m_period(_period) {}
+			bool await_ready() const { return false; }
+			void await_suspend(task::handle h) const
+			{
+				task::promise_type& p = h.promise();
+				if (p.next_tick == clock::time_point()) p.next_tick = clock::now();
+				p.next_tick += m_period;
+				p.owner->wake_at(p.next_tick, h);
+			}
+			void await_resume() const {}
+		private:
+			clock::duration m_period;
+	};
+
+	/**
+	 * Resume at the next multiple of `period` since the task's first tick, so
+	 * the time spent between ticks does not accumulate into drift (unlike
+	 * ClockPulser)
+	 */
+	template<class Rep, class Period>
+	tick_awaiter next_tick(const std::chrono::duration<Rep, Period>& period)
+	{
+		return tick_awaiter(std::chrono::duration_cast<clock::duration>(period));
+	}
+
+	/**
+	 * Notification for tasks, with `notifiable` semantics: notifications
+	 * sent while no task waits are counted, each one lets a later `notified`
+	 * through, and each notification resumes one waiting task.
+	 */
+	class event
+	{
+		public:
+			class awaiter
+			{
+				public:
+					explicit awaiter(event& _target) : m_target(_target) {}
+					bool await_ready() const { return false; }
+					bool await_suspend(task::handle h) const
+					{
+						std::lock_guard<std::mutex> lock(m_target.m_mutex);
+						if (m_target.m_pending)
+						{
+							--m_target.m_pending;
+							return false; // consume and keep running
+						}
+						m_target.m_waiters.push_back(h);
+						return true;
+					}
+					void await_resume() const {}
+				private:
+					event& m_target;
+			};
+
+		public:
+			void notify()
+			{
+				task::handle h;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					if (m_waiters.empty())
+					{
+						++m_pending;
+						return;
+					}
+					h = m_waiters.front();
+					m_waiters.pop_front();
+				}
+				h.promise().owner->schedule(h);
+			}
+
+		private:
+			std::mutex               m_mutex;
+			std::deque<task::handle> m_waiters;
+			std::size_t              m_pending = 0; // notifications nobody waited for
+	};
+
+	/**
+	 * Resume once `e` is notified
+	 */
+	inline event::awaiter notified(event& e)
+	{
+		return event::awaiter(e);
+	}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef EPOCH_HH
+#define EPOCH_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "clock.hh"
+#include "queue.hh"
+#include "thread.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                        Epoch-based reclamation                          */
+	/***************************************************************************/
+	/**
+	 * Counters of the reclamation domain
+	 */
+	struct epoch_stats
+	{
+		std::uint64_t epoch;   // current global epoch
+		std::size_t   pending; // retired objects not freed yet
+		std::uint64_t freed;   // objects freed so far
+		std::uint64_t stalls;  // collections blocked by a thread pinning an old epoch
+		std::uint64_t refused; // retires refused at the limit
+	};
+
+	/**
+	 * Process-wide epoch-based reclamation.
+	 *
+	 * Readers of a lock-free structure hold an `epoch_guard` while they may
+	 * dereference shared nodes; the guard announces the global epoch in a
+	 * per-thread record (no shared writes besides the thread's own cache
+	 * line). Writers unlink a node, then `retire` it. `collect` advances the
+	 * epoch once every active thread has announced the current one, and frees
+	 * what was retired two epochs ago: no guard taken before the unlink can
+	 * still be active then.
+	 *
+	 * Threads register on first use and release their record when they exit,
+	 * so registration follows the lifetime of a PolymorphicThread (or any
+	 * thread). Collection is meant to run from an `EpochReclaimer`; `retire`
+	 * also collects itself when more than `threshold()` objects are pending,
+	 * which helps while the reclaimer lags. After a collection the trigger
+	 * becomes twice what is still pending (at least `threshold()`), so a
+	 * collection that cannot free anything is not retried on every retire.
+	 *
+	 * At most `limit()` objects are pending. A thread stalled inside a guard
+	 * blocks reclamation entirely (collections it blocked are counted in
+	 * `stalls`); once the limit is reached `retire` collects, and if nothing
+	 * could be freed it refuses the object and returns false. The caller
+	 * still owns a refused object: keep it aside and retire it again later.
+	 */
+	class epoch_domain
+	{
+		public:
+			static epoch_domain& instance()
+			{
+				static epoch_domain global;
+				return global;
+			}
+
+			/**
+			 * Hand `object` over for destruction with `deleter` once no reader
+			 * can reach it. Call after unlinking it. Returns false, leaving
+			 * `object` to the caller, when `limit()` objects are pending.
+			 */
+			bool retire(void* object, void (*deleter)(void*))
+			{
+				if (!reserve())
+				{
+					collect();
+					if (!reserve())
+					{
+						m_refused.fetch_add(1, std::memory_order_relaxed);
+						return false;
+					}
+				}
+				retired* node = new retired;
+				node->object  = object;
+				node->deleter = deleter;
+				node->epoch   = m_epoch.load(std::memory_order_seq_cst);
+				m_retired.push(node);
+				if (m_count.load(std::memory_order_relaxed) > m_trigger.load(std::memory_order_relaxed))
+				{
+					std::unique_lock<std::mutex> lock(m_collect, std::try_to_lock);
+					if (lock) collect_locked();
+				}
+				return true;
+			}
+			template<class T>
+			bool retire(T* object)
+			{
+				return retire(object, [](void* p){ delete static_cast<T*>(p); });
+			}
+
+			/**
+			 * Try to advance the epoch and free what became unreachable.
+			 * Returns the number of objects freed.
+			 */
+			std::size_t collect()
+			{
+				std::lock_guard<std::mutex> lock(m_collect);
+				return collect_locked();
+			}
+			/**
+			 * Collect over enough epochs to free everything retired so far,
+			 * unless a thread inside a guard holds the epoch back
+			 */
+			std::size_t drain()
+			{
+				std::lock_guard<std::mutex> lock(m_collect);
+				std::size_t freed = 0;
+				for (int round = 0; round < 3; ++round) freed += collect_locked();
+				return freed;
+			}
+
+			void threshold(std::size_t _threshold) { m_threshold.store(_threshold, std::memory_order_relaxed); m_trigger.store(_threshold, std::memory_order_relaxed); }
+			std::size_t threshold() const         { return m_threshold.load(std::memory_order_relaxed); }
+			void limit(std::size_t _limit)         { m_limit.store(_limit, std::memory_order_relaxed); }
+			std::size_t limit() const             { return m_limit.load(std::memory_order_relaxed); }
+
+			epoch_stats stats() const
+			{
+				return {
+					m_epoch.load(std::memory_order_relaxed),
+					m_count.load(std::memory_order_relaxed),
+					m_freed.load(std::memory_order_relaxed),
+					m_stalls.load(std::memory_order_relaxed),
+					m_refused.load(std::memory_order_relaxed),
+				};
+			}
+
+		private:
+			friend class epoch_guard;
+
+			static constexpr std::uint64_t quiescent = std::numeric_limits<std::uint64_t>::max();
+
+			struct alignas(cache_line) record
+			{
+				std::atomic<std::uint64_t> epoch  = quiescent; // announced epoch, `quiescent` outside guards
+				std::atomic<bool>          in_use = true;
+				std::size_t                depth  = 0;         // nested guards, owner thread only
+				record*                    next   = nullptr;   // immutable once published
+			};
+
+			struct retired : mpsc_node
+			{
+				void*         object;
+				void        (*deleter)(void*);
+				std::uint64_t epoch;
+
+				static void* operator new(std::size_t)   { return block_pool<sizeof(retired)>::allocate();  }
+				static void  operator delete(void* block) { block_pool<sizeof(retired)>::deallocate(block); }
+			};
+
+			/**
+			 * Releases the thread's record when the thread exits
+			 */
+			struct registration
+			{
+				record* owned = nullptr;
+				~registration()
+				{
+					if (!owned) return;
+					owned->epoch.store(quiescent, std::memory_order_release);
+					owned->in_use.store(false, std::memory_order_release);
+				}
+			};
+
+		private:
+			epoch_domain() = default;
+			~epoch_domain()
+			{
+				m_retired.consume_all([this](retired* r){ m_pending.push_back(r); });
+				for (retired* r : m_pending) { r->deleter(r->object); delete r; }
+				for (record* r = m_records.load(); r; )
+				{
+					record* next = r->next;
+					delete r;
+					r = next;
+				}
+			}
+
+			record& local()
+			{
+				static thread_local registration self;
+				if (!self.owned) self.owned = acquire();
+				return *self.owned;
+			}
+			/**
+			 * Count one more pending object, unless the limit is reached
+			 */
+			bool reserve()
+			{
+				std::size_t count = m_count.load(std::memory_order_relaxed);
+				do
+				{
+					if (count >= m_limit.load(std::memory_order_relaxed)) return false;
+				}
+				while (!m_count.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+				return true;
+			}
+			record* acquire()
+			{
+				for (record* r = m_records.load(std::memory_order_acquire); r; r = r->next)
+				{
+					bool used = false;
+					if (!r->in_use.load(std::memory_order_relaxed) && r->in_use.compare_exchange_strong(used, true, std::memory_order_acquire)) return r;
+				}
+				record* r = new record;
+				r->next = m_records.load(std::memory_order_relaxed);
+				while (!m_records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed));
+				return r;
+			}
+			void enter()
+			{
+				record& self = local();
+				if (self.depth++) return;
+				self.epoch.store(m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+			}
+			void leave()
+			{
+				record& self = local();
+				if (--self.depth) return;
+				self.epoch.store(quiescent, std::memory_order_release);
+			}
+			std::size_t collect_locked()
+			{
+				m_retired.consume_all([this](retired* r){ m_pending.push_back(r); });
+
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				std::uint64_t epoch = m_epoch.load(std::memory_order_relaxed);
+				bool advance = true;
+				for (record* r = m_records.load(std::memory_order_acquire); r; r = r->next)
+				{
+					std::uint64_t announced = r->epoch.load(std::memory_order_acquire);
+					if (announced != quiescent && announced != epoch) { advance = false; break; }
+				}
+				if (advance) m_epoch.store(++epoch, std::memory_order_seq_cst);
+				else         m_stalls.fetch_add(1, std::memory_order_relaxed);
+
+				std::size_t kept = 0;
+				std::size_t freed = 0;
+				for (retired* r : m_pending)
+				{
+					if (r->epoch + 2 <= epoch)
+					{
+						r->deleter(r->object);
+						delete r;
+						++freed;
+					}
+					else m_pending[kept++] = r;
+				}
+				m_pending.resize(kept);
+				m_count.fetch_sub(freed, std::memory_order_relaxed);
+				m_trigger.store(std::max(m_threshold.load(std::memory_order_relaxed), 2 * kept), std::memory_order_relaxed); // back off while objects stay pending
+				m_freed.fetch_add(freed, std::memory_order_relaxed);
+				return freed;
+			}
+
+		private:
+			alignas(cache_line) std::atomic<std::uint64_t> m_epoch = 0;
+			std::atomic<record*>                           m_records = nullptr;
+			mpsc_queue<retired>                            m_retired;
+			std::mutex                                     m_collect;
+			std::vector<retired*>                          m_pending; // guarded by m_collect
+			std::atomic<std::size_t>                       m_count     = 0;       // pending objects, queued or in m_pending
+			std::atomic<std::size_t>                       m_threshold = 4096;
+			std::atomic<std::size_t>                       m_trigger   = 4096;    // pending count making `retire` collect
+			std::atomic<std::size_t>                       m_limit     = 1 << 20; // pending count making `retire` refuse
+			std::atomic<std::uint64_t>                     m_freed     = 0;
+			std::atomic<std::uint64_t>                     m_stalls    = 0;
+			std::atomic<std::uint64_t>                     m_refused   = 0;
+	};
+
+	/**
+	 * Critical section of a reader, nodes reached while it lives are not freed
+	 */
+	class epoch_guard
+	{
+		public:
+			epoch_guard()  { epoch_domain::instance().enter(); }
+			~epoch_guard() { epoch_domain::instance().leave(); }
+			epoch_guard(const epoch_guard&) = delete;
+			epoch_guard& operator=(const epoch_guard&) = delete;
+	};
+
+	template<class T>
+	bool retire(T* object)
+	{
+		return epoch_domain::instance().retire(object);
+	}
+
+	/**
+	 * Background collection of retired objects, every interval
+	 */
+	template<class I, class C = steady_sleeper>
+	class EpochReclaimer : public ClockPulser<I, C>
+	{
+		public:
+			using ClockPulser<I, C>::ClockPulser;
+
+		private:
+			void tick() final
+			{
+				epoch_domain::instance().collect();
+			}
+	};
+
+}
+
+#endif
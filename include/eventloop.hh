@@ -0,0 +1,305 @@
+#ifndef EVENTLOOP_HH
+#define EVENTLOOP_HH
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "thread.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                           epoll based event loop                        */
+	/***************************************************************************/
+	/**
+	 * One thread serving timers (timerfd), notifications (eventfd) and
+	 * arbitrary file descriptors from a single `epoll_wait`.
+	 *
+	 * Every source has a callback receiving a count: timer expirations,
+	 * notifications coalesced since the last call, or the epoll event mask
+	 * for plain descriptors. Sources may be added and removed from any
+	 * thread, callbacks run on the loop thread. System call failures throw
+	 * `std::system_error`, except in the loop thread: a failing `epoll_wait`
+	 * stops the loop and is reported by `loop_error()`.
+	 *
+	 * Registrations are told apart by a token carried in the epoll events,
+	 * not by descriptor: events still pending for a removed source are
+	 * dropped, even if its descriptor number was reused by a newer source.
+	 * A source removed by a callback is not called again, not even for the
+	 * rest of the current batch. Removing from another thread can still
+	 * race with a call the loop thread has just started. Descriptors
+	 * created by the loop are closed once the loop thread is done with them.
+	 */
+	class EventLoop : public PolymorphicThread<>
+	{
+		private:
+			struct source;
+
+		public:
+			using callback = std::function<void(std::uint64_t)>;
+
+			/**
+			 * Cheap handle to wake a notification source from any thread, does
+			 * nothing once the source was removed
+			 */
+			class notifier
+			{
+				public:
+					notifier() = default;
+					void notify() const
+					{
+						std::shared_ptr<source> s = m_source.lock(); // keeps the descriptor open
+						if (s && !s->removed) signal(s->fd);
+					}
+					/**
+					 * Descriptor of the source, for `remove`, -1 once it is gone
+					 */
+					int fd() const
+					{
+						std::shared_ptr<source> s = m_source.lock();
+						return s && !s->removed ? s->fd : -1;
+					}
+				private:
+					friend class EventLoop;
+					notifier(std::weak_ptr<source> _source) : m_source(std::move(_source)) {}
+					std::weak_ptr<source> m_source;
+			};
+
+		public:
+			EventLoop()
+			: m_epoll{ check(::epoll_create1(EPOLL_CLOEXEC)) }
+			, m_wake { check(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) }
+			{
+				watch(m_wake.fd, EPOLLIN, wake_token);
+			}
+			EventLoop(const EventLoop&) = delete;
+			EventLoop& operator=(const EventLoop&) = delete;
+			~EventLoop()
+			{
+				if (active())
+				{
+					interrupt();
+					join();
+				}
+				m_sources.clear(); // closes the descriptors created by the loop
+				m_tokens .clear();
+			}
+
+			/**
+			 * Fire after `first`, then every `period` (one shot if zero).
+			 * Returns the timer's descriptor, usable with `remove`.
+			 */
+			template<class First, class Period = First>
+			int add_timer(const First& first, callback cb, const Period& period = Period::zero())
+			{
+				int fd = check(::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK));
+				itimerspec spec{};
+				spec.it_value    = timespec_of(first);
+				spec.it_interval = timespec_of(period);
+				if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1; // zero disarms
+				if (::timerfd_settime(fd, 0, &spec, nullptr) < 0)
+				{
+					int error = errno;
+					::close(fd);
+					throw std::system_error(error, std::generic_category(), "timerfd_settime");
+				}
+				add(fd, EPOLLIN, std::move(cb), true, true);
+				return fd;
+			}
+			/**
+			 * Notification source: `notify()` on the returned handle (from any
+			 * thread) runs `cb` on the loop with the number of notifications
+			 */
+			notifier add_notifier(callback cb)
+			{
+				int fd = check(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+				return notifier(add(fd, EPOLLIN, std::move(cb), true, true));
+			}
+			/**
+			 * Watch a descriptor owned by the caller, `cb` gets the epoll mask
+			 */
+			void add_fd(int fd, std::uint32_t events, callback cb)
+			{
+				add(fd, events, std::move(cb), false, false);
+			}
+			/**
+			 * Stop watching `fd`, closing it if the loop created it
+			 */
+			void remove(int fd)
+			{
+				std::shared_ptr<source> s;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					auto it = m_sources.find(fd);
+					if (it == m_sources.end()) return;
+					s = std::move(it->second);
+					m_sources.erase(it);
+					m_tokens.erase(s->token);
+					s->removed = true;
+				}
+				::epoll_ctl(m_epoll.fd, EPOLL_CTL_DEL, fd, nullptr);
+			}
+			/**
+			 * Clears a previous interruption, so a joined loop can run again
+			 */
+			void start() override
+			{
+				m_interrupted = false;
+				PolymorphicThread::start();
+			}
+			void interrupt()
+			{
+				m_interrupted = true;
+				signal(m_wake.fd);
+			}
+			/**
+			 * Error number that stopped the loop thread, 0 while it serves
+			 */
+			int loop_error() const { return m_loop_error; }
+
+		private:
+			struct source
+			{
+				~source()
+				{
+					if (owned) ::close(fd); // last reference gone, the loop thread cannot read a reused number
+				}
+				callback          cb;
+				int               fd      = -1;
+				std::uint64_t     token   = 0;
+				bool              owned   = false; // created (and closed) by the loop
+				bool              counter = false; // timerfd/eventfd: read the 8 byte count
+				std::atomic<bool> removed = false; // set under the mutex, checked again before each call
+			};
+			struct descriptor
+			{
+				int fd = -1;
+				~descriptor() { if (fd >= 0) ::close(fd); }
+			};
+			static constexpr std::uint64_t wake_token = 0;
+
+			void run() final
+			{
+				epoll_event events[64];
+				while (!m_interrupted)
+				{
+					int n = ::epoll_wait(m_epoll.fd, events, 64, -1);
+					if (n < 0)
+					{
+						if (errno == EINTR) continue;
+						m_loop_error = errno; // throwing here would terminate the process
+						return;
+					}
+					for (int i = 0; i < n && !m_interrupted; ++i)
+					{
+						std::uint64_t token = events[i].data.u64;
+						if (token == wake_token) { drain(m_wake.fd); continue; }
+						std::shared_ptr<source> s;
+						{
+							std::lock_guard<std::mutex> lock(m_mutex);
+							auto it = m_tokens.find(token);
+							if (it == m_tokens.end()) continue; // removed meanwhile, possibly by an earlier callback
+							s = it->second;
+						}
+						if (!s->counter) { if (!s->removed) s->cb(events[i].events); continue; }
+						std::uint64_t count = drain(s->fd);
+						if (count && !s->removed) s->cb(count);
+					}
+				}
+			}
+			std::shared_ptr<source> add(int fd, std::uint32_t events, callback cb, bool owned, bool counter)
+			{
+				auto s = std::make_shared<source>();
+				s->cb      = std::move(cb);
+				s->fd      = fd;
+				s->owned   = owned;
+				s->counter = counter;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					if (m_sources.count(fd)) // keep the existing registration
+					{
+						throw std::system_error(EEXIST, std::generic_category(), "EventLoop");
+					}
+					s->token = m_next_token++;
+					m_sources.emplace(fd, s);
+					m_tokens .emplace(s->token, s);
+				}
+				try
+				{
+					watch(fd, events, s->token);
+				}
+				catch (...)
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_sources.erase(fd);
+						m_tokens .erase(s->token);
+					}
+					throw;
+				}
+				return s;
+			}
+			void watch(int fd, std::uint32_t events, std::uint64_t token)
+			{
+				epoll_event event{};
+				event.events   = events;
+				event.data.u64 = token;
+				check(::epoll_ctl(m_epoll.fd, EPOLL_CTL_ADD, fd, &event));
+			}
+			static void signal(int fd)
+			{
+				std::uint64_t one = 1;
+				while (::write(fd, &one, sizeof(one)) < 0 && errno == EINTR);
+			}
+			static std::uint64_t drain(int fd)
+			{
+				std::uint64_t count = 0;
+				if (::read(fd, &count, sizeof(count)) != sizeof(count)) return 0;
+				return count;
+			}
+			static int check(int result)
+			{
+				if (result < 0) throw std::system_error(errno, std::generic_category(), "EventLoop");
+				return result;
+			}
+			template<class D>
+			static timespec timespec_of(const D& d)
+			{
+				auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+				timespec ts;
+				ts.tv_sec  = ns / 1000000000;
+				ts.tv_nsec = ns % 1000000000;
+				return ts;
+			}
+
+		private:
+			const descriptor                                           m_epoll; // declared first: closed last
+			const descriptor                                           m_wake;
+			std::atomic<bool>                                          m_interrupted = false;
+			std::atomic<int>                                           m_loop_error  = 0;
+			std::mutex                                                 m_mutex;
+			std::unordered_map<int, std::shared_ptr<source>>           m_sources; // by descriptor, for `remove`
+			std::unordered_map<std::uint64_t, std::shared_ptr<source>> m_tokens;  // by token, for events
+			std::uint64_t                                              m_next_token = wake_token + 1;
+	};
+
+}
+
+#endif
+
+#endif
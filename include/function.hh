@@ -0,0 +1,104 @@
+#ifndef FUNCTION_HH
+#define FUNCTION_HH
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace madag::sync
+{
+
+	template<class Signature, std::size_t Capacity = 64>
+	class inplace_function;
+
+	/**
+	 * Move-only callable wrapper storing its target in a fixed inline buffer.
+	 *
+	 * Unlike `std::function` it never allocates: a callable that does not fit
+	 * in `Capacity` bytes (or needs more than `std::max_align_t` alignment) is
+	 * rejected at compile time. Calling an empty one throws
+	 * `std::bad_function_call`.
+	 */
+	template<class R, class... Args, std::size_t Capacity>
+	class inplace_function<R(Args...), Capacity>
+	{
+		public:
+			static constexpr std::size_t capacity = Capacity;
+
+		public:
+			inplace_function() = default;
+			inplace_function(std::nullptr_t) {}
+			template<class F, class Fn = std::decay_t<F>, class = std::enable_if_t<!std::is_same_v<Fn, inplace_function> && std::is_invocable_r_v<R, Fn&, Args...>>>
+			inplace_function(F&& f)
+			{
+				static_assert(sizeof(Fn)  <= Capacity,                    "callable too large for inplace_function");
+				static_assert(alignof(Fn) <= alignof(std::max_align_t),   "callable over-aligned for inplace_function");
+				static_assert(std::is_nothrow_move_constructible_v<Fn>,   "callable must be nothrow movable");
+				::new (static_cast<void*>(m_storage)) Fn(std::forward<F>(f));
+				m_operations = &operations_for<Fn>;
+			}
+			inplace_function(inplace_function&& other) noexcept
+			{
+				take(other);
+			}
+			inplace_function& operator=(inplace_function&& other) noexcept
+			{
+				if (this != &other)
+				{
+					reset();
+					take(other);
+				}
+				return *this;
+			}
+			inplace_function(const inplace_function&) = delete;
+			inplace_function& operator=(const inplace_function&) = delete;
+			~inplace_function()
+			{
+				reset();
+			}
+
+			R operator()(Args... args)
+			{
+				if (!m_operations) throw std::bad_function_call();
+				return m_operations->invoke(m_storage, std::forward<Args>(args)...);
+			}
+			explicit operator bool() const
+			{
+				return m_operations != nullptr;
+			}
+			void reset()
+			{
+				if (m_operations) m_operations->destroy(m_storage);
+				m_operations = nullptr;
+			}
+
+		private:
+			struct operations
+			{
+				R    (*invoke )(void*, Args&&...);
+				void (*move   )(void* to, void* from); // move construct, then destroy `from`
+				void (*destroy)(void*);
+			};
+			template<class Fn>
+			static constexpr operations operations_for = {
+				[](void* f, Args&&... args) -> R { return (*static_cast<Fn*>(f))(std::forward<Args>(args)...); },
+				[](void* to, void* from) { ::new (to) Fn(std::move(*static_cast<Fn*>(from))); static_cast<Fn*>(from)->~Fn(); },
+				[](void* f) { static_cast<Fn*>(f)->~Fn(); },
+			};
+			void take(inplace_function& other) noexcept
+			{
+				if (other.m_operations) other.m_operations->move(m_storage, other.m_storage);
+				m_operations = other.m_operations;
+				other.m_operations = nullptr;
+			}
+
+		private:
+			alignas(std::max_align_t) std::byte m_storage[Capacity];
+			const operations*                   m_operations = nullptr;
+	};
+
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef FUTEX_HH
+#define FUTEX_HH
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+#include "queue.hh"
+
+#ifdef __linux__
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#endif
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                                  Futex                                  */
+	/***************************************************************************/
+	/**
+	 * Wait on / wake a 32-bit word. `futex_wait` sleeps only if the word still
+	 * holds `expected` and may return spuriously, callers re-check their
+	 * condition. A zero timeout waits forever. Linux uses the futex system
+	 * call (private to the process), other systems a hashed table of parking
+	 * spots.
+	 */
+#ifdef __linux__
+	inline void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds timeout = std::chrono::nanoseconds::zero())
+	{
+		static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word must be a plain 32-bit integer");
+		timespec  spec;
+		timespec* limit = nullptr;
+		if (timeout > std::chrono::nanoseconds::zero())
+		{
+			spec.tv_sec  = time_t(timeout.count() / 1000000000);
+			spec.tv_nsec = long  (timeout.count() % 1000000000);
+			limit = &spec;
+		}
+		::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, limit, nullptr, 0);
+	}
+	inline void futex_wake(std::atomic<std::uint32_t>& word, int count = INT_MAX)
+	{
+		::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+	}
+#else
+	namespace detail
+	{
+		struct parking_spot
+		{
+			std::mutex              mutex;
+			std::condition_variable condition;
+		};
+		inline parking_spot& parking(const void* address)
+		{
+			static parking_spot table[64];
+			return table[std::hash<const void*>()(address) % 64];
+		}
+	}
+	inline void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds timeout = std::chrono::nanoseconds::zero())
+	{
+		detail::parking_spot& spot = detail::parking(&word);
+		std::unique_lock<std::mutex> lock(spot.mutex);
+		if (word.load() != expected) return;
+		if (timeout > std::chrono::nanoseconds::zero()) spot.condition.wait_for(lock, timeout);
+		else                                            spot.condition.wait(lock);
+	}
+	inline void futex_wake(std::atomic<std::uint32_t>& word, int = INT_MAX)
+	{
+		detail::parking_spot& spot = detail::parking(&word);
+		std::unique_lock<std::mutex> lock(spot.mutex);
+		spot.condition.notify_all(); // spots are shared, wake everyone
+	}
+#endif
+
+	/***************************************************************************/
+	/*                             Broadcast event                             */
+	/***************************************************************************/
+	/**
+	 * Generation counter waking every current waiter at once. `broadcast()`
+	 * bumps the generation and issues a single futex wake for all sleepers;
+	 * they return without re-acquiring any lock, so a large pool resumes
+	 * without convoying on a mutex. Waiters pass the generation they last saw,
+	 * so a broadcast between reading it and waiting is never missed. Waiters
+	 * spin briefly before parking; the broadcaster skips the system call when
+	 * nobody is parked.
+	 */
+	class broadcast_event
+	{
+		public:
+			std::uint32_t generation() const
+			{
+				return m_generation.load(std::memory_order_acquire);
+			}
+			/**
+			 * Block until the generation moves past `seen`, returns the new one
+			 */
+			std::uint32_t wait(std::uint32_t seen, unsigned spins = 64)
+			{
+				std::uint32_t current;
+				for (unsigned i = 0; i < spins; ++i)
+				{
+					if ((current = generation()) != seen) return current;
+					std::this_thread::yield();
+				}
+				m_waiters.fetch_add(1);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				while ((current = generation()) == seen) futex_wait(m_generation, seen);
+				m_waiters.fetch_sub(1);
+				return current;
+			}
+			/**
+			 * Same, giving up after `timeout` (returns `seen` then)
+			 */
+			template<class Rep, class Period>
+			std::uint32_t wait_for(std::uint32_t seen, const std::chrono::duration<Rep, Period>& timeout)
+			{
+				auto deadline = std::chrono::steady_clock::now() + timeout;
+				m_waiters.fetch_add(1);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				std::uint32_t current;
+				while ((current = generation()) == seen)
+				{
+					auto left = deadline - std::chrono::steady_clock::now();
+					if (left <= left.zero()) break;
+					futex_wait(m_generation, seen, std::chrono::duration_cast<std::chrono::nanoseconds>(left));
+				}
+				m_waiters.fetch_sub(1);
+				return current;
+			}
+			/**
+			 * Wake every thread waiting on the current generation
+			 */
+			void broadcast()
+			{
+				m_generation.fetch_add(1, std::memory_order_release);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (m_waiters.load(std::memory_order_relaxed)) futex_wake(m_generation);
+			}
+			std::uint32_t waiters() const
+			{
+				return m_waiters.load(std::memory_order_relaxed);
+			}
+
+		private:
+			alignas(cache_line) std::atomic<std::uint32_t> m_generation = 0;
+			alignas(cache_line) std::atomic<std::uint32_t> m_waiters    = 0;
+	};
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef GROUP_HH
+#define GROUP_HH
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "thread.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                              Thread group                               */
+	/***************************************************************************/
+	/**
+	 * Owns a set of threads (pulsers, event loops, any PolymorphicThread<>
+	 * with an `interrupt()`) to shut them down together.
+	 *
+	 * `interrupt_all()` interrupts every member before waiting for any: pulsers
+	 * sleeping on their clock policy or parked on notifications wake up at
+	 * once, so shutting a group down takes as long as its slowest tick rather
+	 * than the sum of all intervals. `join_all()` waits up to a deadline and
+	 * returns the names of the members still running (stragglers stay in the
+	 * group). Pulsers and event loops clear their interruption when started,
+	 * so `start_all()` restarts a group that was shut down.
+	 *
+	 * Members must outlive their thread: self-deleting threads (such as
+	 * SelfDeletingTimer) are rejected.
+	 */
+	class ThreadGroup
+	{
+		public:
+			ThreadGroup() = default;
+			ThreadGroup(const ThreadGroup&) = delete;
+			ThreadGroup& operator=(const ThreadGroup&) = delete;
+			/**
+			 * Interrupts every member then joins them without any limit, so it
+			 * blocks as long as the slowest member: call `shutdown(timeout)`
+			 * first to bound the wait and learn about stragglers
+			 */
+			~ThreadGroup()
+			{
+				interrupt_all();
+				for (member& m : m_members) if (m.thread->active()) m.thread->join();
+			}
+
+			/**
+			 * Take ownership of `thread` (started or not). Throws
+			 * `std::invalid_argument` for a self-deleting thread, which would
+			 * be deleted twice.
+			 */
+			template<class T>
+			T& adopt(std::unique_ptr<T> thread)
+			{
+				if (static_cast<const PolymorphicThread<>&>(*thread).self_deleting()) throw std::invalid_argument("ThreadGroup: self-deleting threads cannot be owned");
+				T& result = *thread;
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_members.push_back({ std::move(thread), [&result]{ result.interrupt(); } });
+				return result;
+			}
+			template<class T, class... Args>
+			T& emplace(Args&&... args)
+			{
+				return adopt(std::make_unique<T>(std::forward<Args>(args)...));
+			}
+
+			void start_all()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (member& m : m_members) if (!m.thread->active()) m.thread->start();
+			}
+			void interrupt_all()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (member& m : m_members) m.interrupt();
+			}
+			/**
+			 * Join every member that finishes within `timeout`, returns the
+			 * names of those that did not
+			 */
+			template<class Rep, class Period>
+			std::vector<std::string> join_all(const std::chrono::duration<Rep, Period>& timeout)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto deadline = std::chrono::steady_clock::now() + timeout;
+				auto pause    = std::chrono::microseconds(50);
+				for (;;)
+				{
+					bool pending = false;
+					for (member& m : m_members)
+					{
+						if (!m.thread->active()) continue;
+						if (m.thread->finished()) m.thread->join();
+						else                      pending = true;
+					}
+					if (!pending || std::chrono::steady_clock::now() >= deadline) break;
+					std::this_thread::sleep_for(pause);
+					if (pause < std::chrono::milliseconds(5)) pause *= 2;
+				}
+				std::vector<std::string> stragglers;
+				for (member& m : m_members)
+				{
+					if (m.thread->active()) stragglers.push_back(m.thread->options().name);
+				}
+				return stragglers;
+			}
+			/**
+			 * `interrupt_all()` then `join_all(timeout)`
+			 */
+			template<class Rep, class Period>
+			std::vector<std::string> shutdown(const std::chrono::duration<Rep, Period>& timeout)
+			{
+				interrupt_all();
+				return join_all(timeout);
+			}
+			std::size_t size()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return m_members.size();
+			}
+
+		private:
+			struct member
+			{
+				std::unique_ptr<PolymorphicThread<>> thread;
+				std::function<void()>                interrupt;
+			};
+
+		private:
+			std::mutex          m_mutex;
+			std::vector<member> m_members;
+	};
+
+}
+
+#endif
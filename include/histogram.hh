@@ -0,0 +1,113 @@
+#ifndef HISTOGRAM_HH
+#define HISTOGRAM_HH
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace madag::sync
+{
+
+	/**
+	 * Copy of a histogram at some point in time
+	 */
+	struct histogram_snapshot
+	{
+		std::uint64_t              count = 0;
+		std::uint64_t              sum   = 0;
+		std::uint64_t              max   = 0;
+		std::vector<std::uint64_t> buckets; // counts, see `histogram::lower_bound`
+		std::vector<std::uint64_t> bounds;  // smallest value of each bucket
+
+		double mean() const
+		{
+			return count ? double(sum) / double(count) : 0.;
+		}
+		/**
+		 * Smallest bucket bound below which `p` (in [0,1]) of the values lie
+		 */
+		std::uint64_t percentile(double p) const
+		{
+			if (!count) return 0;
+			std::uint64_t target = std::uint64_t(p * double(count));
+			if (target >= count) target = count - 1;
+			std::uint64_t seen = 0;
+			for (std::size_t i = 0; i < buckets.size(); ++i)
+			{
+				seen += buckets[i];
+				if (seen > target) return bounds[i];
+			}
+			return max;
+		}
+	};
+
+	/**
+	 * Lock-free log-linear histogram (HDR style).
+	 *
+	 * Values below 2^SubBits get their own bucket, above that every power of
+	 * two is split in 2^SubBits linear buckets, so the relative error is at
+	 * most 2^-SubBits over the whole 64 bit range. Recording is a handful of
+	 * relaxed atomic operations, safe from any number of threads.
+	 */
+	template<unsigned SubBits = 3>
+	class histogram
+	{
+		public:
+			static constexpr std::size_t sub_buckets = std::size_t(1) << SubBits;
+			static constexpr std::size_t size        = (65 - SubBits) * sub_buckets;
+
+		public:
+			void record(std::uint64_t value)
+			{
+				m_buckets[index(value)].fetch_add(1, std::memory_order_relaxed);
+				m_count.fetch_add(1, std::memory_order_relaxed);
+				m_sum.fetch_add(value, std::memory_order_relaxed);
+				std::uint64_t max = m_max.load(std::memory_order_relaxed);
+				while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+			}
+			/**
+			 * Counters are read one by one, a snapshot taken while recording is
+			 * only approximately consistent. `reset` clears what was read.
+			 */
+			histogram_snapshot snapshot(bool reset = false)
+			{
+				histogram_snapshot result;
+				result.buckets.resize(size);
+				result.bounds.resize(size);
+				for (std::size_t i = 0; i < size; ++i)
+				{
+					result.buckets[i] = reset ? m_buckets[i].exchange(0, std::memory_order_relaxed)
+					                          : m_buckets[i].load(std::memory_order_relaxed);
+					result.bounds[i]  = lower_bound(i);
+				}
+				result.count = reset ? m_count.exchange(0, std::memory_order_relaxed) : m_count.load(std::memory_order_relaxed);
+				result.sum   = reset ? m_sum  .exchange(0, std::memory_order_relaxed) : m_sum  .load(std::memory_order_relaxed);
+				result.max   = reset ? m_max  .exchange(0, std::memory_order_relaxed) : m_max  .load(std::memory_order_relaxed);
+				return result;
+			}
+			static std::size_t index(std::uint64_t value)
+			{
+				if (value < sub_buckets) return std::size_t(value);
+				unsigned exponent = 63 - unsigned(__builtin_clzll(value));
+				std::size_t sub   = std::size_t(value >> (exponent - SubBits)) & (sub_buckets - 1);
+				return (exponent - SubBits + 1) * sub_buckets + sub;
+			}
+			static std::uint64_t lower_bound(std::size_t index)
+			{
+				if (index < sub_buckets) return index;
+				unsigned exponent = unsigned(index / sub_buckets) + SubBits - 1;
+				return (std::uint64_t(sub_buckets + index % sub_buckets)) << (exponent - SubBits);
+			}
+
+		private:
+			std::array<std::atomic<std::uint64_t>, size> m_buckets = {};
+			std::atomic<std::uint64_t>                   m_count   = 0;
+			std::atomic<std::uint64_t>                   m_sum     = 0;
+			std::atomic<std::uint64_t>                   m_max     = 0;
+	};
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef OPTIONS_HH
+#define OPTIONS_HH
+
+#include <cerrno>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace madag::sync
+{
+
+	/**
+	 * Placement and scheduling of a thread, applied by the thread itself
+	 * before `run()` executes. Fields left to their default inherit from the
+	 * creating thread. Only implemented on Linux, ignored elsewhere (except
+	 * `stack_size`, honoured wherever pthreads are available).
+	 */
+	struct thread_options
+	{
+		std::string      name;           // shown by top/perf, truncated to 15 characters
+		std::vector<int> cpus;           // CPU affinity set
+		int              numa_node = -1; // run on (if `cpus` is empty) and allocate from this node
+		int              policy    = -1; // SCHED_OTHER, SCHED_FIFO, SCHED_RR...
+		int              priority  = 0;  // static priority for `policy`
+		std::size_t      stack_size = 0; // bytes
+
+		/**
+		 * CPUs of a NUMA node, as listed by sysfs ("0-3,8-11")
+		 */
+		static std::vector<int> node_cpus(int node)
+		{
+			std::vector<int> cpus;
+			std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string range;
+			while (std::getline(list, range, ','))
+			{
+				std::size_t dash = range.find('-');
+				try
+				{
+					int first = std::stoi(range.substr(0, dash));
+					int last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+					for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+				}
+				catch (const std::exception&)
+				{
+					// blank or malformed entry
+				}
+			}
+			return cpus;
+		}
+
+		/**
+		 * Apply to the calling thread. Every setting is attempted; returns the
+		 * errno of the first one that failed (e.g. EPERM for SCHED_FIFO
+		 * without the privilege), 0 on success.
+		 */
+		int apply() const
+		{
+			int error = 0;
+#ifdef __linux__
+			auto failed = [&error](int code) { if (code && !error) error = code; };
+			pthread_t self = pthread_self();
+			if (!name.empty())
+			{
+				failed(pthread_setname_np(self, name.substr(0, 15).c_str()));
+			}
+			std::vector<int> affinity = cpus.empty() && numa_node >= 0 ? node_cpus(numa_node) : cpus;
+			if (!affinity.empty())
+			{
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				for (int cpu : affinity) if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+				failed(pthread_setaffinity_np(self, sizeof(set), &set));
+			}
+			if (numa_node >= 0)
+			{
+				constexpr std::size_t bits = 8 * sizeof(unsigned long);
+				std::vector<unsigned long> mask(std::size_t(numa_node) / bits + 1, 0);
+				mask[std::size_t(numa_node) / bits] |= 1ul << (std::size_t(numa_node) % bits);
+				if (syscall(SYS_set_mempolicy, MPOL_BIND, mask.data(), mask.size() * bits + 1)) failed(errno);
+			}
+			if (policy >= 0)
+			{
+				sched_param param{};
+				param.sched_priority = priority;
+				failed(pthread_setschedparam(self, policy, &param));
+			}
+#endif
+			return error;
+		}
+	};
+
+}
+
+#endif
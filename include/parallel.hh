@@ -0,0 +1,310 @@
+#ifndef PARALLEL_HH
+#define PARALLEL_HH
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "function.hh"
+#include "primitives.hh"
+#include "queue.hh"
+#include "thread.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                               Thread pool                               */
+	/***************************************************************************/
+	/**
+	 * Fixed set of PolymorphicThread workers serving a shared MPMC task queue.
+	 *
+	 * The algorithms below submit helper tasks and let the calling thread work
+	 * too. While waiting for its helpers a caller runs queued tasks, so nested
+	 * parallel calls from inside a task cannot starve the pool.
+	 */
+	class ThreadPool
+	{
+		public:
+			using task = inplace_function<void(void), 64>;
+
+		public:
+			ThreadPool(std::size_t _threads, std::size_t _capacity = 4096)
+			: m_tasks(_capacity)
+			{
+				for (std::size_t i = 0; i < _threads; ++i)
+				{
+					m_workers.emplace_back(new Worker(m_tasks));
+					m_workers.back()->start();
+				}
+			}
+			ThreadPool(const ThreadPool&) = delete;
+			ThreadPool& operator=(const ThreadPool&) = delete;
+			~ThreadPool()
+			{
+				m_tasks.close();
+				for (auto& worker : m_workers) worker->join();
+			}
+			/**
+			 * Pool shared by default, one worker per hardware thread besides the
+			 * caller
+			 */
+			static ThreadPool& shared()
+			{
+				static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+				return pool;
+			}
+
+			/**
+			 * Blocks while the queue is full. Returns false after shutdown.
+			 */
+			bool submit(task&& t)     { return m_tasks.push(std::move(t));     }
+			bool try_submit(task&& t) { return m_tasks.try_push(std::move(t)); }
+			/**
+			 * Run one queued task on the calling thread, false if none was queued
+			 */
+			bool run_one()
+			{
+				task t;
+				if (!m_tasks.try_pop(t)) return false;
+				t();
+				return true;
+			}
+			std::size_t size() const { return m_workers.size(); }
+
+		private:
+			class Worker : public PolymorphicThread<>
+			{
+				public:
+					Worker(mpmc_queue<task>& _tasks) : m_tasks(_tasks) {}
+				private:
+					void run() final
+					{
+						task t;
+						while (m_tasks.pop(t)) t();
+					}
+				private:
+					mpmc_queue<task>& m_tasks;
+			};
+
+		private:
+			mpmc_queue<task>                     m_tasks;
+			std::vector<std::unique_ptr<Worker>> m_workers;
+	};
+
+	/***************************************************************************/
+	/*                              parallel_for                               */
+	/***************************************************************************/
+	namespace detail
+	{
+		/**
+		 * Index range shared by the caller and its helpers. Participants claim
+		 * chunks of `remaining / (2 * participants)` indices (at least `grain`):
+		 * large chunks first, smaller ones towards the end to even out the
+		 * finish. The first exception thrown stops the claiming and is rethrown
+		 * to the caller.
+		 */
+		template<class Body>
+		class range_job
+		{
+			public:
+				range_job(std::size_t _first, std::size_t _last, std::size_t _grain, std::size_t _participants, Body& _body)
+				: m_next(_first)
+				, m_last(_last)
+				, m_grain(std::max<std::size_t>(1, _grain))
+				, m_participants(_participants)
+				, m_body(_body)
+				{
+				}
+				void work()
+				{
+					try
+					{
+						std::size_t begin, end;
+						while (claim(begin, end)) m_body(begin, end);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> lock(m_error_mutex);
+						if (!m_error) m_error = std::current_exception();
+						m_next.store(m_last, std::memory_order_relaxed);
+					}
+				}
+				void rethrow()
+				{
+					if (m_error) std::rethrow_exception(m_error);
+				}
+
+			private:
+				bool claim(std::size_t& begin, std::size_t& end)
+				{
+					begin = m_next.load(std::memory_order_relaxed);
+					for (;;)
+					{
+						if (begin >= m_last) return false;
+						std::size_t chunk = std::max(m_grain, (m_last - begin) / (2 * m_participants));
+						end = std::min(m_last, begin + chunk);
+						if (m_next.compare_exchange_weak(begin, end, std::memory_order_relaxed)) return true;
+					}
+				}
+
+			private:
+				alignas(cache_line) std::atomic<std::size_t> m_next;
+				const std::size_t                            m_last;
+				const std::size_t                            m_grain;
+				const std::size_t                            m_participants;
+				Body&                                        m_body;
+				std::mutex                                   m_error_mutex;
+				std::exception_ptr                           m_error;
+		};
+	}
+
+	/**
+	 * Call `body(begin, end)` on disjoint chunks covering [first, last), each
+	 * at least `grain` long (except the last), in parallel on `pool`
+	 */
+	template<class Body>
+	void parallel_for_chunks(std::size_t first, std::size_t last, Body&& body, std::size_t grain = 1, ThreadPool& pool = ThreadPool::shared())
+	{
+		if (first >= last) return;
+		std::size_t chunks  = (last - first + std::max<std::size_t>(1, grain) - 1) / std::max<std::size_t>(1, grain);
+		std::size_t helpers = std::min(pool.size(), chunks - 1);
+		if (!helpers)
+		{
+			body(first, last);
+			return;
+		}
+		detail::range_job<std::remove_reference_t<Body>> job(first, last, grain, helpers + 1, body);
+		latch done{std::uint32_t(helpers)};
+		std::size_t submitted = 0;
+		for (; submitted < helpers; ++submitted)
+		{
+			if (!pool.try_submit([&]{ job.work(); done.count_down(); })) break;
+		}
+		if (submitted < helpers) done.count_down(std::uint32_t(helpers - submitted));
+		job.work();
+		while (!done.try_wait() && pool.run_one());
+		done.wait(); // helpers still queued were taken by other threads
+		job.rethrow();
+	}
+
+	/**
+	 * Call `f(i)` for every i in [first, last) in parallel on `pool`
+	 */
+	template<class F>
+	void parallel_for(std::size_t first, std::size_t last, F&& f, std::size_t grain = 1, ThreadPool& pool = ThreadPool::shared())
+	{
+		parallel_for_chunks(first, last, [&](std::size_t begin, std::size_t end)
+		{
+			for (std::size_t i = begin; i < end; ++i) f(i);
+		}, grain, pool);
+	}
+
+	/***************************************************************************/
+	/*                         Reduce / scan / sort                            */
+	/***************************************************************************/
+	namespace detail
+	{
+		/**
+		 * Number of blocks the block-wise algorithms split `n` elements into
+		 */
+		inline std::size_t blocks(std::size_t n, std::size_t grain, const ThreadPool& pool)
+		{
+			std::size_t wanted = 4 * (pool.size() + 1);
+			return std::max<std::size_t>(1, std::min(wanted, n / std::max<std::size_t>(1, grain)));
+		}
+	}
+
+	/**
+	 * Fold [first, last) into `init` with the associative `op`. Blocks are
+	 * reduced in parallel and combined in order, so `op` need not commute and
+	 * the result is deterministic.
+	 */
+	template<class RandomIt, class T, class BinaryOp = std::plus<>>
+	T parallel_reduce(RandomIt first, RandomIt last, T init, BinaryOp op = BinaryOp(), std::size_t grain = 2048, ThreadPool& pool = ThreadPool::shared())
+	{
+		std::size_t n      = std::size_t(last - first);
+		std::size_t blocks = detail::blocks(n, grain, pool);
+		if (blocks == 1) return std::accumulate(first, last, init, op);
+		std::vector<T> partial(blocks);
+		parallel_for(0, blocks, [&](std::size_t b)
+		{
+			RandomIt begin = first + std::ptrdiff_t(n * b / blocks);
+			RandomIt end   = first + std::ptrdiff_t(n * (b + 1) / blocks);
+			T acc = *begin;
+			for (++begin; begin != end; ++begin) acc = op(std::move(acc), *begin);
+			partial[b] = std::move(acc);
+		}, 1, pool);
+		for (T& p : partial) init = op(std::move(init), std::move(p));
+		return init;
+	}
+
+	/**
+	 * Inclusive prefix combination of [first, last) into `out` (which may be
+	 * `first`). Two parallel passes: block totals, then each block rescanned
+	 * from the combined totals of the blocks before it.
+	 */
+	template<class RandomIt, class OutIt, class BinaryOp = std::plus<>>
+	OutIt parallel_scan(RandomIt first, RandomIt last, OutIt out, BinaryOp op = BinaryOp(), std::size_t grain = 2048, ThreadPool& pool = ThreadPool::shared())
+	{
+		using T = typename std::iterator_traits<RandomIt>::value_type;
+		std::size_t n      = std::size_t(last - first);
+		std::size_t blocks = detail::blocks(n, grain, pool);
+		if (blocks == 1) return std::partial_sum(first, last, out, op);
+		auto bound = [&](std::size_t b){ return std::ptrdiff_t(n * b / blocks); };
+		std::vector<T> totals(blocks);
+		parallel_for(0, blocks, [&](std::size_t b)
+		{
+			RandomIt begin = first + bound(b);
+			RandomIt end   = first + bound(b + 1);
+			T acc = *begin;
+			for (++begin; begin != end; ++begin) acc = op(std::move(acc), *begin);
+			totals[b] = std::move(acc);
+		}, 1, pool);
+		for (std::size_t b = 1; b < blocks; ++b) totals[b] = op(totals[b - 1], totals[b]);
+		parallel_for(0, blocks, [&](std::size_t b)
+		{
+			RandomIt begin = first + bound(b);
+			RandomIt end   = first + bound(b + 1);
+			OutIt    to    = out   + bound(b);
+			if (b == 0) { std::partial_sum(begin, end, to, op); return; }
+			T acc = totals[b - 1];
+			for (; begin != end; ++begin, ++to) *to = acc = op(acc, *begin);
+		}, 1, pool);
+		return out + std::ptrdiff_t(n);
+	}
+
+	/**
+	 * Sort blocks in parallel, then merge neighbours pairwise, each round of
+	 * merges in parallel. Not stable.
+	 */
+	template<class RandomIt, class Compare = std::less<>>
+	void parallel_sort(RandomIt first, RandomIt last, Compare comp = Compare(), std::size_t grain = 8192, ThreadPool& pool = ThreadPool::shared())
+	{
+		std::size_t n      = std::size_t(last - first);
+		std::size_t blocks = detail::blocks(n, grain, pool);
+		if (blocks == 1) return std::sort(first, last, comp);
+		auto bound = [&](std::size_t b){ return first + std::ptrdiff_t(n * std::min(b, blocks) / blocks); };
+		parallel_for(0, blocks, [&](std::size_t b){ std::sort(bound(b), bound(b + 1), comp); }, 1, pool);
+		for (std::size_t width = 1; width < blocks; width *= 2)
+		{
+			std::size_t merges = (blocks + 2 * width - 1) / (2 * width);
+			parallel_for(0, merges, [&](std::size_t m)
+			{
+				std::size_t b = m * 2 * width;
+				if (b + width < blocks) std::inplace_merge(bound(b), bound(b + width), bound(b + 2 * width), comp);
+			}, 1, pool);
+		}
+	}
+
+}
+
+#endif
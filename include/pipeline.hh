@@ -0,0 +1,180 @@
+#ifndef PIPELINE_HH
+#define PIPELINE_HH
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+#include "queue.hh"
+#include "thread.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                                  Utils                                  */
+	/***************************************************************************/
+	/**
+	 * What a producer does when the next stage's queue is full
+	 */
+	enum class overflow
+	{
+		block, // wait for the consumer to make room
+		drop,  // discard the item and count it
+	};
+
+	/**
+	 * Anything items of type T can be pushed into
+	 */
+	template<class T>
+	class sink
+	{
+		public:
+			virtual ~sink() = default;
+			virtual bool push(T&& item) = 0;
+	};
+
+	struct stage_stats
+	{
+		std::size_t processed; // items handed to `process`
+		std::size_t pushed;    // items accepted in the input queue
+		std::size_t dropped;   // items rejected (full queue with `overflow::drop`, or interrupted)
+		std::size_t blocked;   // times a producer had to wait for room
+		std::size_t occupancy; // items currently queued
+		std::size_t capacity;  // input queue capacity
+	};
+
+	/***************************************************************************/
+	/*                             Pipeline stage                              */
+	/***************************************************************************/
+	/**
+	 * Pulser consuming a bounded input queue and emitting to the next stage.
+	 *
+	 * Producers only wake the stage when it went idle, and the stage only
+	 * wakes blocked producers when some are waiting, so a busy pipeline runs
+	 * without touching the notifiables. `Queue` must be safe for the number of
+	 * upstream producers: the default ring is single producer, use a MPMC queue
+	 * for fan-in.
+	 */
+	template<class In, class Out = void, class Queue = spsc_ring<In>>
+	class PipelineStage : public NotifiedPulser, public sink<In>
+	{
+		public:
+			using input  = In;
+			using output = Out;
+			using queue  = Queue;
+
+		public:
+			PipelineStage(std::size_t _capacity, overflow _policy = overflow::block)
+			: m_queue(_capacity)
+			, m_policy(_policy)
+			{
+			}
+			bool push(input&& item) final
+			{
+				while (!m_queue.try_push(std::move(item)))
+				{
+					if (m_policy == overflow::drop || m_interrupted)
+					{
+						m_dropped.fetch_add(1, std::memory_order_relaxed);
+						if (m_interrupted) m_space.notify(); // release the next blocked producer
+						return false;
+					}
+					m_blocked.fetch_add(1, std::memory_order_relaxed);
+					m_waiting.fetch_add(1);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (m_queue.full() && !m_interrupted) m_space.wait();
+					m_waiting.fetch_sub(1);
+				}
+				m_pushed.fetch_add(1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (m_idle.exchange(false)) wakeup();
+				if (m_waiting.load(std::memory_order_relaxed) && !m_queue.full()) m_space.notify();
+				return true;
+			}
+			void connect(sink<output>& next)
+			{
+				m_next = &next;
+			}
+			void interrupt() override
+			{
+				NotifiedPulser::interrupt();
+				m_space.notify();
+			}
+			stage_stats stats() const
+			{
+				return {
+					m_processed.load(std::memory_order_relaxed),
+					m_pushed   .load(std::memory_order_relaxed),
+					m_dropped  .load(std::memory_order_relaxed),
+					m_blocked  .load(std::memory_order_relaxed),
+					m_queue.size(),
+					m_queue.capacity(),
+				};
+			}
+
+		protected:
+			virtual void process(input&& item) = 0;
+			/**
+			 * Forward an item to the connected stage, false if it was dropped
+			 */
+			template<class U>
+			bool emit(U&& item)
+			{
+				return m_next && m_next->push(output(std::forward<U>(item)));
+			}
+
+		private:
+			void tick() final
+			{
+				for (;;)
+				{
+					input item;
+					while (m_queue.try_pop(item))
+					{
+						if (m_waiting.load(std::memory_order_relaxed)) m_space.notify();
+						process(std::move(item));
+						m_processed.fetch_add(1, std::memory_order_relaxed);
+					}
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (m_waiting.load(std::memory_order_relaxed)) m_space.notify();
+					// go idle, unless an item slipped in before producers could see it
+					m_idle.store(true);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (m_queue.empty() || m_interrupted) return;
+					m_idle.store(false);
+				}
+			}
+
+		private:
+			queue                    m_queue;
+			overflow                 m_policy;
+			sink<output>*            m_next = nullptr;
+			notifiable               m_space;
+			std::atomic<bool>        m_idle      = true;
+			std::atomic<std::size_t> m_waiting   = 0;
+			std::atomic<std::size_t> m_processed = 0;
+			std::atomic<std::size_t> m_pushed    = 0;
+			std::atomic<std::size_t> m_dropped   = 0;
+			std::atomic<std::size_t> m_blocked   = 0;
+	};
+
+	/**
+	 * Connect stages in order: connect(a, b, c) links a → b → c
+	 */
+	template<class First, class Second>
+	Second& connect(First& first, Second& second)
+	{
+		first.connect(second);
+		return second;
+	}
+	template<class First, class Second, class... Rest>
+	auto& connect(First& first, Second& second, Rest&... rest)
+	{
+		first.connect(second);
+		return connect(second, rest...);
+	}
+
+}
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef PRIMITIVES_HH
+#define PRIMITIVES_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+
+#include "function.hh"
+#include "futex.hh"
+#include "queue.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                                  Utils                                  */
+	/***************************************************************************/
+	/**
+	 * Every primitive below waits the same way: poll its word `spins` times
+	 * (a few pause instructions, then yielding the processor), then register
+	 * as a waiter and park on the futex. Releasers only make the wake system
+	 * call when a waiter is registered.
+	 */
+	inline constexpr unsigned default_spins = 64;
+
+	namespace detail
+	{
+		inline void cpu_relax()
+		{
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#elif defined(__aarch64__)
+			asm volatile("yield");
+#else
+			std::this_thread::yield();
+#endif
+		}
+		template<class Predicate>
+		bool spin(Predicate&& ready, unsigned spins)
+		{
+			for (unsigned i = 0; i < spins; ++i)
+			{
+				if (ready()) return true;
+				if (i < 16) cpu_relax();
+				else        std::this_thread::yield();
+			}
+			return ready();
+		}
+	}
+
+	/**
+	 * Slow path counters, the uncontended paths do not touch them
+	 */
+	struct contention_stats
+	{
+		std::uint64_t contended; // operations that could not complete immediately
+		std::uint64_t parks;     // futex waits
+	};
+
+	class contention_counters
+	{
+		public:
+			contention_stats stats(bool reset = false)
+			{
+				return {
+					reset ? m_contended.exchange(0, std::memory_order_relaxed) : m_contended.load(std::memory_order_relaxed),
+					reset ? m_parks    .exchange(0, std::memory_order_relaxed) : m_parks    .load(std::memory_order_relaxed),
+				};
+			}
+		protected:
+			void contended() { m_contended.fetch_add(1, std::memory_order_relaxed); }
+			void parked()    { m_parks    .fetch_add(1, std::memory_order_relaxed); }
+		private:
+			std::atomic<std::uint64_t> m_contended = 0;
+			std::atomic<std::uint64_t> m_parks     = 0;
+	};
+
+	namespace detail
+	{
+		/**
+		 * Empty stand-in for `contention_counters`
+		 */
+		class no_counters
+		{
+			protected:
+				void contended() {}
+				void parked()    {}
+		};
+	}
+
+	/***************************************************************************/
+	/*                               Futex mutex                               */
+	/***************************************************************************/
+	/**
+	 * Mutex on a four-byte word (0 free, 1 locked, 2 locked with possible
+	 * sleepers). Meets the Lockable requirements, usable with std::lock_guard.
+	 * `futex_mutex` is four bytes, `counted_futex_mutex` adds the
+	 * `contention_counters`.
+	 */
+	template<bool Counted = false, unsigned Spins = default_spins>
+	class basic_futex_mutex : public std::conditional_t<Counted, contention_counters, detail::no_counters>
+	{
+		public:
+			basic_futex_mutex() = default;
+			basic_futex_mutex(const basic_futex_mutex&) = delete;
+			basic_futex_mutex& operator=(const basic_futex_mutex&) = delete;
+
+			bool try_lock()
+			{
+				std::uint32_t expected = 0;
+				return m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+			}
+			void lock()
+			{
+				if (try_lock()) return;
+				this->contended();
+				if (detail::spin([this]{ return m_state.load(std::memory_order_relaxed) == 0 && try_lock(); }, Spins)) return;
+				while (m_state.exchange(2, std::memory_order_acquire) != 0)
+				{
+					this->parked();
+					futex_wait(m_state, 2);
+				}
+			}
+			void unlock()
+			{
+				if (m_state.exchange(0, std::memory_order_release) == 2) futex_wake(m_state, 1);
+			}
+
+		private:
+			std::atomic<std::uint32_t> m_state = 0;
+	};
+
+	using futex_mutex         = basic_futex_mutex<>;
+	using counted_futex_mutex = basic_futex_mutex<true>;
+	static_assert(sizeof(futex_mutex) == 4, "futex_mutex must stay a single futex word");
+
+	/***************************************************************************/
+	/*                            Counting semaphore                           */
+	/***************************************************************************/
+	class semaphore : public contention_counters
+	{
+		public:
+			semaphore(std::uint32_t _initial = 0, unsigned _spins = default_spins)
+			: m_count(_initial)
+			, m_spins(_spins)
+			{
+			}
+			semaphore(const semaphore&) = delete;
+			semaphore& operator=(const semaphore&) = delete;
+
+			bool try_acquire()
+			{
+				std::uint32_t count = m_count.load(std::memory_order_relaxed);
+				while (count)
+				{
+					if (m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed)) return true;
+				}
+				return false;
+			}
+			void acquire()
+			{
+				if (try_acquire()) return;
+				contended();
+				if (detail::spin([this]{ return try_acquire(); }, m_spins)) return;
+				m_waiters.fetch_add(1);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				while (!try_acquire())
+				{
+					parked();
+					futex_wait(m_count, 0);
+				}
+				m_waiters.fetch_sub(1);
+			}
+			/**
+			 * Returns false if no unit became available within `timeout`
+			 */
+			template<class Rep, class Period>
+			bool try_acquire_for(const std::chrono::duration<Rep, Period>& timeout)
+			{
+				if (try_acquire()) return true;
+				contended();
+				auto deadline = std::chrono::steady_clock::now() + timeout;
+				m_waiters.fetch_add(1);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				bool acquired;
+				while (!(acquired = try_acquire()))
+				{
+					auto left = deadline - std::chrono::steady_clock::now();
+					if (left <= left.zero()) break;
+					parked();
+					futex_wait(m_count, 0, std::chrono::duration_cast<std::chrono::nanoseconds>(left));
+				}
+				m_waiters.fetch_sub(1);
+				return acquired;
+			}
+			void release(std::uint32_t count = 1)
+			{
+				m_count.fetch_add(count, std::memory_order_release);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (m_waiters.load(std::memory_order_relaxed)) futex_wake(m_count, int(count));
+			}
+			std::uint32_t available() const { return m_count.load(std::memory_order_relaxed); }
+
+		private:
+			alignas(cache_line) std::atomic<std::uint32_t> m_count;
+			std::atomic<std::uint32_t>                     m_waiters = 0;
+			unsigned                                       m_spins;
+	};
+
+	/***************************************************************************/
+	/*                             Countdown latch                             */
+	/***************************************************************************/
+	/**
+	 * Single use: waiters block until `count_down` brought the count to zero.
+	 *
+	 * Parked waiters are flagged in the top bit of the count itself, so the
+	 * thread bringing it to zero touches nothing else afterwards: a waiter
+	 * may destroy the latch as soon as it returns (typical when it lives on
+	 * the waiter's stack).
+	 */
+	class latch : public contention_counters
+	{
+		public:
+			latch(std::uint32_t _count, unsigned _spins = default_spins)
+			: m_count(_count & count_mask)
+			, m_spins(_spins)
+			{
+			}
+			latch(const latch&) = delete;
+			latch& operator=(const latch&) = delete;
+
+			void count_down(std::uint32_t n = 1)
+			{
+				std::uint32_t previous = m_count.fetch_sub(n, std::memory_order_acq_rel);
+				if ((previous & count_mask) == n && (previous & sleepers)) futex_wake(m_count);
+			}
+			bool try_wait() const
+			{
+				return (m_count.load(std::memory_order_acquire) & count_mask) == 0;
+			}
+			void wait()
+			{
+				if (try_wait()) return;
+				contended();
+				if (detail::spin([this]{ return try_wait(); }, m_spins)) return;
+				std::uint32_t count = m_count.load(std::memory_order_acquire);
+				while (count & count_mask)
+				{
+					if (!(count & sleepers) && !m_count.compare_exchange_weak(count, count | sleepers, std::memory_order_acquire)) continue;
+					parked();
+					futex_wait(m_count, count | sleepers);
+					count = m_count.load(std::memory_order_acquire);
+				}
+			}
+			void arrive_and_wait(std::uint32_t n = 1)
+			{
+				count_down(n);
+				wait();
+			}
+
+		private:
+			static constexpr std::uint32_t sleepers   = 0x80000000u;
+			static constexpr std::uint32_t count_mask = ~sleepers;
+
+		private:
+			alignas(cache_line) std::atomic<std::uint32_t> m_count;
+			unsigned                                       m_spins;
+	};
+
+	/***************************************************************************/
+	/*                              Cyclic barrier                             */
+	/***************************************************************************/
+	/**
+	 * Reusable rendezvous of `count` threads. The last one to arrive runs the
+	 * optional completion, resets the count and releases the phase through a
+	 * `broadcast_event`, so all waiters are woken by a single system call.
+	 */
+	class barrier : public contention_counters
+	{
+		public:
+			using completion = inplace_function<void(void), 64>;
+
+		public:
+			barrier(std::uint32_t _count, completion&& _completion = {}, unsigned _spins = default_spins)
+			: m_expected(_count)
+			, m_remaining(_count)
+			, m_completion(std::move(_completion))
+			, m_spins(_spins)
+			{
+			}
+			barrier(const barrier&) = delete;
+			barrier& operator=(const barrier&) = delete;
+
+			/**
+			 * Returns true for the thread that completed the phase
+			 */
+			bool arrive_and_wait()
+			{
+				std::uint32_t phase = m_phase.generation();
+				if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					if (m_completion) m_completion();
+					m_remaining.store(m_expected, std::memory_order_relaxed);
+					m_phase.broadcast();
+					return true;
+				}
+				if (m_phase.generation() != phase) return false;
+				contended();
+				if (detail::spin([&]{ return m_phase.generation() != phase; }, m_spins)) return false;
+				parked();
+				m_phase.wait(phase, 0);
+				return false;
+			}
+			std::uint32_t phase() const { return m_phase.generation(); }
+
+		private:
+			const std::uint32_t                            m_expected;
+			alignas(cache_line) std::atomic<std::uint32_t> m_remaining;
+			broadcast_event                                m_phase;
+			completion                                     m_completion;
+			unsigned                                       m_spins;
+	};
+
+}
+
+#endif
@@ -0,0 +1,565 @@
+#ifndef QUEUE_HH
+#define QUEUE_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                                  Utils                                  */
+	/***************************************************************************/
+	/**
+	 * Padding used to keep data written by different threads apart
+	 */
+	inline constexpr std::size_t cache_line = 64;
+
+	namespace detail
+	{
+		/**
+		 * Fences for a handshake between a rare side (a thread about to park)
+		 * and a frequent one (every push and pop). On Linux the rare side
+		 * issues a process-wide barrier with membarrier(2), which leaves only a
+		 * compiler barrier to the frequent side; without it, both sides use a
+		 * full fence.
+		 */
+		inline bool process_barrier()
+		{
+#ifdef __linux__
+			static const bool available = ::syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+			return available;
+#else
+			return false;
+#endif
+		}
+		inline void light_fence()
+		{
+			if (process_barrier()) std::atomic_signal_fence(std::memory_order_seq_cst);
+			else                   std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+		inline void heavy_fence()
+		{
+#ifdef __linux__
+			if (process_barrier() && ::syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0) return;
+#endif
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+	}
+
+	/**
+	 * Parking spot for threads waiting on a lock-free structure. Waiters
+	 * register before checking their condition under the mutex, so notifiers
+	 * only lock (and signal) when someone is actually parked. The ordering
+	 * between the two is paid by the waiter (`detail::heavy_fence`): a
+	 * notification nobody waits for costs a load.
+	 */
+	class waitlist
+	{
+		public:
+			template<class Predicate>
+			void wait(Predicate&& ready)
+			{
+				m_waiters.fetch_add(1);
+				detail::heavy_fence();
+				{
+					std::unique_lock<decltype(m_mutex)> lock(m_mutex);
+					while (!ready()) m_condition.wait(lock);
+				}
+				m_waiters.fetch_sub(1);
+			}
+			void notify_one()
+			{
+				detail::light_fence();
+				if (!m_waiters.load(std::memory_order_relaxed)) return;
+				std::unique_lock<decltype(m_mutex)> lock(m_mutex);
+				m_condition.notify_one();
+			}
+			void notify_all()
+			{
+				detail::light_fence();
+				if (!m_waiters.load(std::memory_order_relaxed)) return;
+				std::unique_lock<decltype(m_mutex)> lock(m_mutex);
+				m_condition.notify_all();
+			}
+
+		private:
+			std::mutex               m_mutex;
+			std::condition_variable  m_condition;
+			std::atomic<std::size_t> m_waiters = 0;
+	};
+
+	/***************************************************************************/
+	/*                      Intrusive MPSC (bounded) queue                     */
+	/***************************************************************************/
+	/**
+	 * Hook for messages stored in a `mpsc_queue`. Messages derive from it, the
+	 * queue never allocates.
+	 */
+	class mpsc_node
+	{
+		template<class> friend class mpsc_queue;
+		private:
+			mpsc_node* m_next = nullptr;
+	};
+
+	enum class mpsc_push
+	{
+		full,   // capacity reached, message not queued
+		queued, // queued behind other messages
+		first,  // queued in an empty queue, consumer should be notified
+	};
+
+	/**
+	 * Many producers push with a CAS on the head, the single consumer detaches
+	 * the whole list with one exchange and walks it in FIFO order. A push into
+	 * an empty queue reports `mpsc_push::first`, which is the only transition
+	 * that needs to wake the consumer.
+	 */
+	template<class T>
+	class mpsc_queue
+	{
+		public:
+			mpsc_queue(std::size_t _capacity = std::numeric_limits<std::size_t>::max())
+			: m_capacity(_capacity)
+			{
+			}
+			mpsc_queue(const mpsc_queue&) = delete;
+			mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+			mpsc_push push(T* message)
+			{
+				if (m_size.fetch_add(1, std::memory_order_relaxed) >= m_capacity)
+				{
+					m_size.fetch_sub(1, std::memory_order_relaxed);
+					return mpsc_push::full;
+				}
+				mpsc_node* node = message;
+				mpsc_node* head = m_head.load(std::memory_order_relaxed);
+				do { node->m_next = head; }
+				while (!m_head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+				return head ? mpsc_push::queued : mpsc_push::first;
+			}
+			/**
+			 * Detach every queued message and hand them to `f` in FIFO order.
+			 * `f` receives ownership and may destroy the message. Consumer only.
+			 */
+			template<class F>
+			std::size_t consume_all(F&& f)
+			{
+				mpsc_node* lifo = m_head.exchange(nullptr, std::memory_order_acquire);
+				mpsc_node* fifo = nullptr;
+				std::size_t count = 0;
+				while (lifo)
+				{
+					mpsc_node* next = lifo->m_next;
+					lifo->m_next = fifo;
+					fifo = lifo;
+					lifo = next;
+					++count;
+				}
+				m_size.fetch_sub(count, std::memory_order_relaxed);
+				while (fifo)
+				{
+					mpsc_node* next = fifo->m_next;
+					f(static_cast<T*>(fifo));
+					fifo = next;
+				}
+				return count;
+			}
+			bool empty() const
+			{
+				return m_head.load(std::memory_order_relaxed) == nullptr;
+			}
+			std::size_t size() const
+			{
+				return m_size.load(std::memory_order_relaxed);
+			}
+			std::size_t capacity() const
+			{
+				return m_capacity;
+			}
+
+		private:
+			std::atomic<mpsc_node*>  m_head = nullptr;
+			std::atomic<std::size_t> m_size = 0;
+			std::size_t              m_capacity;
+	};
+
+	/***************************************************************************/
+	/*                        SPSC bounded ring buffer                         */
+	/***************************************************************************/
+	/**
+	 * Single producer / single consumer wait-free ring. The capacity is rounded
+	 * up to a power of two so indices wrap with a mask. Producer and consumer
+	 * indices live on separate cache lines, and each side keeps a private copy
+	 * of the other's index, only reloading it when the ring looks full (resp.
+	 * empty), so steady-state transfers do not bounce cache lines. A failed
+	 * `try_push` leaves its argument untouched.
+	 */
+	template<class T>
+	class spsc_ring
+	{
+		public:
+			using value_type = T;
+
+		public:
+			spsc_ring(std::size_t _capacity)
+			: m_mask(ceil_pow2(_capacity) - 1)
+			, m_buffer(new T[m_mask + 1])
+			{
+			}
+			spsc_ring(const spsc_ring&) = delete;
+			spsc_ring& operator=(const spsc_ring&) = delete;
+
+			/**
+			 * Producer side
+			 */
+			template<class U>
+			bool try_push(U&& value)
+			{
+				std::size_t tail = m_tail.load(std::memory_order_relaxed);
+				if (tail - m_head_cache > m_mask)
+				{
+					m_head_cache = m_head.load(std::memory_order_acquire);
+					if (tail - m_head_cache > m_mask) return false;
+				}
+				m_buffer[tail & m_mask] = std::forward<U>(value);
+				m_tail.store(tail + 1, std::memory_order_release);
+				return true;
+			}
+			/**
+			 * Move up to `count` values from `first`, publishing them at once.
+			 * Returns how many were pushed.
+			 */
+			template<class InputIt>
+			std::size_t try_push_n(InputIt first, std::size_t count)
+			{
+				std::size_t tail = m_tail.load(std::memory_order_relaxed);
+				if (m_mask + 1 - (tail - m_head_cache) < count)
+				{
+					m_head_cache = m_head.load(std::memory_order_acquire);
+				}
+				std::size_t room = m_mask + 1 - (tail - m_head_cache);
+				std::size_t n    = count < room ? count : room;
+				for (std::size_t i = 0; i < n; ++i, ++first)
+				{
+					m_buffer[(tail + i) & m_mask] = std::move(*first);
+				}
+				if (n) m_tail.store(tail + n, std::memory_order_release);
+				return n;
+			}
+
+			/**
+			 * Consumer side
+			 */
+			bool try_pop(T& value)
+			{
+				std::size_t head = m_head.load(std::memory_order_relaxed);
+				if (head == m_tail_cache)
+				{
+					m_tail_cache = m_tail.load(std::memory_order_acquire);
+					if (head == m_tail_cache) return false;
+				}
+				value = std::move(m_buffer[head & m_mask]);
+				m_head.store(head + 1, std::memory_order_release);
+				return true;
+			}
+			/**
+			 * Move up to `count` values into `out`, releasing their slots at once.
+			 * Returns how many were popped.
+			 */
+			template<class OutputIt>
+			std::size_t try_pop_n(OutputIt out, std::size_t count)
+			{
+				std::size_t head = m_head.load(std::memory_order_relaxed);
+				if (m_tail_cache - head < count)
+				{
+					m_tail_cache = m_tail.load(std::memory_order_acquire);
+				}
+				std::size_t available = m_tail_cache - head;
+				std::size_t n         = count < available ? count : available;
+				for (std::size_t i = 0; i < n; ++i, ++out)
+				{
+					*out = std::move(m_buffer[(head + i) & m_mask]);
+				}
+				if (n) m_head.store(head + n, std::memory_order_release);
+				return n;
+			}
+
+			/**
+			 * Either side (approximate while the other side is running)
+			 */
+			bool empty() const
+			{
+				return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+			}
+			bool full() const
+			{
+				return size() > m_mask;
+			}
+			std::size_t size() const
+			{
+				std::size_t head = m_head.load(std::memory_order_acquire);
+				return m_tail.load(std::memory_order_acquire) - head;
+			}
+			std::size_t capacity() const
+			{
+				return m_mask + 1;
+			}
+
+		private:
+			static std::size_t ceil_pow2(std::size_t n)
+			{
+				std::size_t p = 1;
+				while (p < n) p <<= 1;
+				return p;
+			}
+
+		private:
+			alignas(cache_line) std::atomic<std::size_t> m_tail = 0; // written by producer
+			std::size_t                                  m_head_cache = 0;
+			alignas(cache_line) std::atomic<std::size_t> m_head = 0; // written by consumer
+			std::size_t                                  m_tail_cache = 0;
+			alignas(cache_line) const std::size_t        m_mask;
+			const std::unique_ptr<T[]>                   m_buffer;
+	};
+
+	/***************************************************************************/
+	/*                           MPMC bounded queue                            */
+	/***************************************************************************/
+	/**
+	 * Multi producer / multi consumer bounded queue (D. Vyukov). Each slot
+	 * carries a sequence number telling whether it is ready to be written or
+	 * read for the current lap, so producers and consumers only contend on
+	 * their own index with a single CAS.
+	 *
+	 * `try_push`/`try_pop` never block. `push`/`pop` spin briefly, then park
+	 * until the queue has room (resp. items) or is closed; the opposite side
+	 * only pays for a wakeup when someone is parked. A failed push leaves its
+	 * argument untouched.
+	 */
+	template<class T>
+	class mpmc_queue
+	{
+		public:
+			using value_type = T;
+
+		public:
+			mpmc_queue(std::size_t _capacity)
+			: m_mask(ceil_pow2(_capacity < 2 ? 2 : _capacity) - 1)
+			, m_cells(new cell[m_mask + 1])
+			{
+				for (std::size_t i = 0; i <= m_mask; ++i)
+				{
+					m_cells[i].sequence.store(i, std::memory_order_relaxed);
+				}
+			}
+			mpmc_queue(const mpmc_queue&) = delete;
+			mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+			/**
+			 * Fails when full or closed
+			 */
+			template<class U>
+			bool try_push(U&& value)
+			{
+				if (closed() || !enqueue(std::forward<U>(value))) return false;
+				m_not_empty.notify_one();
+				return true;
+			}
+			bool try_pop(T& value)
+			{
+				if (!dequeue(value)) return false;
+				m_not_full.notify_one();
+				return true;
+			}
+			/**
+			 * Blocks while full. Returns false if the queue is closed.
+			 */
+			template<class U>
+			bool push(U&& value)
+			{
+				for (int spin = 0; spin < spins; ++spin)
+				{
+					if (closed())                        return false;
+					if (try_push(std::forward<U>(value))) return true;
+				}
+				bool pushed = false;
+				m_not_full.wait([&]{ return closed() || (pushed = enqueue(std::forward<U>(value))); });
+				if (pushed) m_not_empty.notify_one();
+				return pushed;
+			}
+			/**
+			 * Blocks while empty. Returns false once the queue is closed and
+			 * drained.
+			 */
+			bool pop(T& value)
+			{
+				for (int spin = 0; spin < spins; ++spin)
+				{
+					if (try_pop(value)) return true;
+					if (closed())       break;
+				}
+				bool popped = false;
+				m_not_empty.wait([&]{ return (popped = dequeue(value)) || closed(); });
+				if (popped) m_not_full.notify_one();
+				return popped;
+			}
+			/**
+			 * Refuse further pushes and release every parked thread
+			 */
+			void close()
+			{
+				m_closed.store(true);
+				m_not_full.notify_all();
+				m_not_empty.notify_all();
+			}
+			bool closed() const
+			{
+				return m_closed.load(std::memory_order_acquire);
+			}
+			bool empty() const
+			{
+				return size() == 0;
+			}
+			bool full() const
+			{
+				return size() > m_mask;
+			}
+			std::size_t size() const
+			{
+				std::size_t head = m_dequeue.load(std::memory_order_acquire);
+				std::size_t tail = m_enqueue.load(std::memory_order_acquire);
+				return tail > head ? tail - head : 0;
+			}
+			std::size_t capacity() const
+			{
+				return m_mask + 1;
+			}
+
+		private:
+			struct cell
+			{
+				std::atomic<std::size_t> sequence;
+				T                        data;
+			};
+			static constexpr int spins = 64;
+			static std::size_t ceil_pow2(std::size_t n)
+			{
+				std::size_t p = 1;
+				while (p < n) p <<= 1;
+				return p;
+			}
+			/**
+			 * Lock-free operations, without waking the other side
+			 */
+			template<class U>
+			bool enqueue(U&& value)
+			{
+				std::size_t pos = m_enqueue.load(std::memory_order_relaxed);
+				for (;;)
+				{
+					cell& c = m_cells[pos & m_mask];
+					std::ptrdiff_t lap = std::ptrdiff_t(c.sequence.load(std::memory_order_acquire) - pos);
+					if (lap == 0)
+					{
+						if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						{
+							c.data = std::forward<U>(value);
+							c.sequence.store(pos + 1, std::memory_order_release);
+							return true;
+						}
+					}
+					else if (lap < 0) return false; // full
+					else pos = m_enqueue.load(std::memory_order_relaxed);
+				}
+			}
+			bool dequeue(T& value)
+			{
+				std::size_t pos = m_dequeue.load(std::memory_order_relaxed);
+				for (;;)
+				{
+					cell& c = m_cells[pos & m_mask];
+					std::ptrdiff_t lap = std::ptrdiff_t(c.sequence.load(std::memory_order_acquire) - (pos + 1));
+					if (lap == 0)
+					{
+						if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						{
+							value = std::move(c.data);
+							c.sequence.store(pos + m_mask + 1, std::memory_order_release);
+							return true;
+						}
+					}
+					else if (lap < 0) return false; // empty
+					else pos = m_dequeue.load(std::memory_order_relaxed);
+				}
+			}
+
+		private:
+			alignas(cache_line) std::atomic<std::size_t> m_enqueue = 0;
+			alignas(cache_line) std::atomic<std::size_t> m_dequeue = 0;
+			alignas(cache_line) const std::size_t        m_mask;
+			const std::unique_ptr<cell[]>                m_cells;
+			std::atomic<bool>                            m_closed = false;
+			waitlist                                     m_not_full;
+			waitlist                                     m_not_empty;
+	};
+
+	/***************************************************************************/
+	/*                               Block pool                                */
+	/***************************************************************************/
+	/**
+	 * Recycles up to `Capacity` memory blocks of `Size` bytes through a MPMC
+	 * queue, falling back to the global allocator when empty (resp. full).
+	 * Meant for class-specific `operator new`/`operator delete`.
+	 *
+	 * The pool is never destroyed: objects released by detached threads
+	 * during static destruction still find it, and its free blocks are
+	 * reclaimed with the process.
+	 */
+	template<std::size_t Size, std::size_t Capacity = 1024>
+	class block_pool
+	{
+		public:
+			static void* allocate()
+			{
+				void* block;
+				if (instance().m_free.try_pop(block)) return block;
+				return ::operator new(Size);
+			}
+			static void deallocate(void* block)
+			{
+				if (!instance().m_free.try_push(block)) ::operator delete(block);
+			}
+
+		private:
+			block_pool()
+			: m_free(Capacity)
+			{
+			}
+			static block_pool& instance()
+			{
+				static block_pool* global = new block_pool;
+				return *global;
+			}
+
+		private:
+			mpmc_queue<void*> m_free;
+	};
+
+}
+
+#endif
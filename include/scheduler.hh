@@ -0,0 +1,426 @@
+#ifndef SCHEDULER_HH
+#define SCHEDULER_HH
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "function.hh"
+#include "histogram.hh"
+#include "thread.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                         Priority / EDF scheduler                        */
+	/***************************************************************************/
+	/**
+	 * A priority class of a TickScheduler. When `max_wait` is non-zero, a
+	 * ready tick of this class never waits longer than that (roughly: plus
+	 * the tick running on each worker) for higher classes to let it through.
+	 */
+	struct priority_class
+	{
+		std::string              name;
+		std::chrono::nanoseconds max_wait = std::chrono::nanoseconds::zero();
+	};
+
+	/**
+	 * Measurements of one priority class, in nanoseconds
+	 */
+	struct class_stats
+	{
+		std::uint64_t      runs;
+		std::uint64_t      misses;   // ticks finished after their deadline
+		std::uint64_t      promoted; // ticks run ahead of higher classes by starvation protection
+		std::uint64_t      failures; // ticks that threw
+		histogram_snapshot latency;  // release to start
+		histogram_snapshot lateness; // finish past the deadline (0 when on time)
+	};
+
+	/**
+	 * Workers sharing ticks and timer callbacks by priority class, then
+	 * earliest deadline first within a class.
+	 *
+	 * Class 0 is the most urgent. A worker picks its next tick whenever it
+	 * finished one (ticks are never interrupted, preemption happens at tick
+	 * boundaries): the earliest deadline of the most urgent class with ready
+	 * ticks, unless a class has been kept waiting longer than its `max_wait`,
+	 * in which case the longest starved class goes first.
+	 *
+	 * Periodic ticks (`every`) are released each period with the end of the
+	 * period as deadline; periods missed entirely are skipped rather than
+	 * caught up. Callbacks run on the workers and may post more work. An
+	 * exception thrown by a callback is counted in `failures` and dropped, a
+	 * periodic job keeps running. `ScheduledPulser` runs a pulser's ticks
+	 * as such a periodic job.
+	 */
+	class TickScheduler
+	{
+		public:
+			using callback   = inplace_function<void(void), 64>;
+			using job_id     = std::uint64_t;
+			using clock      = std::chrono::steady_clock;
+			using time_point = clock::time_point;
+
+		public:
+			TickScheduler(std::size_t _threads, std::vector<priority_class> _classes)
+			: m_classes(std::move(_classes))
+			, m_state(m_classes.size())
+			{
+				if (m_classes.empty()) throw std::invalid_argument("TickScheduler: no priority class");
+				for (std::size_t i = 0; i < _threads; ++i)
+				{
+					m_workers.emplace_back(new Worker(*this));
+					m_workers.back()->start();
+				}
+			}
+			TickScheduler(const TickScheduler&) = delete;
+			TickScheduler& operator=(const TickScheduler&) = delete;
+			~TickScheduler()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_stopped = true;
+				}
+				m_changed.notify_all();
+				for (auto& worker : m_workers) worker->join();
+				for (auto& [id, j] : m_jobs) delete j;
+			}
+
+			/**
+			 * Run `cb` once, as soon as possible, due within `deadline`. All
+			 * submissions throw `std::out_of_range` for an unknown priority.
+			 */
+			template<class Deadline>
+			job_id post(std::size_t priority, const Deadline& deadline, callback&& cb)
+			{
+				return post_at(clock::now(), priority, deadline, std::move(cb));
+			}
+			/**
+			 * Run `cb` once at `release`, due within `deadline` after it
+			 */
+			template<class Deadline>
+			job_id post_at(time_point release, std::size_t priority, const Deadline& deadline, callback&& cb)
+			{
+				return submit(release, priority, std::chrono::duration_cast<clock::duration>(deadline), clock::duration::zero(), std::move(cb));
+			}
+			/**
+			 * Run `cb` every `period`, each run due by the end of its period
+			 */
+			template<class Period>
+			job_id every(std::size_t priority, const Period& period, callback&& cb)
+			{
+				auto p = std::chrono::duration_cast<clock::duration>(period);
+				return submit(clock::now() + p, priority, p, p, std::move(cb));
+			}
+			/**
+			 * Drop a pending job or stop a periodic one. A job waiting for
+			 * its release or for a worker is removed at once; a run in
+			 * progress completes, and with `wait` the call returns only once
+			 * it did (never wait from the job itself). Unknown or finished
+			 * jobs are ignored.
+			 */
+			void cancel(job_id id, bool wait = false)
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				auto it = m_jobs.find(id);
+				if (it == m_jobs.end()) return;
+				job* j = it->second;
+				if (!j->running)
+				{
+					if (!unqueue(m_timed, j, later_release())) unqueue(m_state[j->priority].ready, j, later_deadline());
+					drop(j);
+					return;
+				}
+				j->cancelled = true; // the worker drops it after the run
+				if (wait) m_finished.wait(lock, [&]{ return !m_jobs.count(id); });
+			}
+			/**
+			 * Whether `id` is still scheduled or running
+			 */
+			bool pending(job_id id) const
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return m_jobs.count(id) != 0;
+			}
+
+			class_stats stats(std::size_t priority, bool reset = false)
+			{
+				klass& k = m_state.at(priority);
+				return {
+					reset ? k.runs    .exchange(0, std::memory_order_relaxed) : k.runs    .load(std::memory_order_relaxed),
+					reset ? k.misses  .exchange(0, std::memory_order_relaxed) : k.misses  .load(std::memory_order_relaxed),
+					reset ? k.promoted.exchange(0, std::memory_order_relaxed) : k.promoted.load(std::memory_order_relaxed),
+					reset ? k.failures.exchange(0, std::memory_order_relaxed) : k.failures.load(std::memory_order_relaxed),
+					k.latency .snapshot(reset),
+					k.lateness.snapshot(reset),
+				};
+			}
+			const std::vector<priority_class>& classes() const { return m_classes; }
+
+		private:
+			struct job
+			{
+				job_id          id;
+				std::size_t     priority;
+				time_point      release;
+				time_point      deadline;
+				clock::duration period;
+				callback        cb;
+				bool            cancelled = false; // while running: drop instead of requeueing (guarded by m_mutex)
+				bool            running   = false;
+			};
+			struct later_release  { bool operator()(const job* a, const job* b) const { return a->release  > b->release;  } };
+			struct later_deadline { bool operator()(const job* a, const job* b) const { return a->deadline > b->deadline; } };
+
+			struct klass
+			{
+				std::vector<job*>          ready;       // heap on deadline
+				time_point                 served_at{}; // last run, or when it became ready while idle
+				std::atomic<std::uint64_t> runs     = 0;
+				std::atomic<std::uint64_t> misses   = 0;
+				std::atomic<std::uint64_t> promoted = 0;
+				std::atomic<std::uint64_t> failures = 0;
+				histogram<>                latency;
+				histogram<>                lateness;
+			};
+
+			class Worker : public PolymorphicThread<>
+			{
+				public:
+					Worker(TickScheduler& _owner) : m_owner(_owner) {}
+				private:
+					void run() final { m_owner.work(); }
+				private:
+					TickScheduler& m_owner;
+			};
+
+			static std::uint64_t nanoseconds(clock::duration d)
+			{
+				return d > clock::duration::zero() ? std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()) : 0;
+			}
+
+			job_id submit(time_point release, std::size_t priority, clock::duration deadline, clock::duration period, callback&& cb)
+			{
+				if (priority >= m_state.size()) throw std::out_of_range("TickScheduler: no such priority class");
+				job* j = new job{ 0, priority, release, release + deadline, period, std::move(cb) };
+				job_id id;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					id = j->id = m_next_id++;
+					m_jobs.emplace(id, j);
+					m_timed.push_back(j);
+					std::push_heap(m_timed.begin(), m_timed.end(), later_release());
+				}
+				m_changed.notify_one();
+				return id;
+			}
+			/**
+			 * Forget a job that will not run again (mutex held)
+			 */
+			void drop(job* j)
+			{
+				m_jobs.erase(j->id);
+				delete j;
+			}
+			/**
+			 * Remove `j` from `heap` if it is there (mutex held)
+			 */
+			template<class Order>
+			static bool unqueue(std::vector<job*>& heap, job* j, Order order)
+			{
+				auto at = std::find(heap.begin(), heap.end(), j);
+				if (at == heap.end()) return false;
+				heap.erase(at);
+				std::make_heap(heap.begin(), heap.end(), order);
+				return true;
+			}
+			/**
+			 * Move the jobs released by `now` to their class (mutex held)
+			 */
+			void release(time_point now)
+			{
+				while (!m_timed.empty() && m_timed.front()->release <= now)
+				{
+					std::pop_heap(m_timed.begin(), m_timed.end(), later_release());
+					job* j = m_timed.back();
+					m_timed.pop_back();
+					klass& k = m_state[j->priority];
+					if (k.ready.empty() && k.served_at < j->release) k.served_at = j->release;
+					k.ready.push_back(j);
+					std::push_heap(k.ready.begin(), k.ready.end(), later_deadline());
+				}
+			}
+			/**
+			 * Next job to run (mutex held), nullptr if none is ready
+			 */
+			job* pick(time_point now, bool& promoted)
+			{
+				std::size_t chosen  = m_state.size();
+				std::size_t starved = m_state.size();
+				for (std::size_t c = 0; c < m_state.size(); ++c)
+				{
+					klass& k = m_state[c];
+					if (k.ready.empty()) continue;
+					if (chosen == m_state.size()) chosen = c;
+					auto limit = m_classes[c].max_wait;
+					if (c != chosen && limit > limit.zero() && now - k.served_at > limit)
+					{
+						if (starved == m_state.size() || k.served_at < m_state[starved].served_at) starved = c;
+					}
+				}
+				promoted = starved != m_state.size();
+				if (promoted) chosen = starved;
+				if (chosen == m_state.size()) return nullptr;
+				klass& k = m_state[chosen];
+				std::pop_heap(k.ready.begin(), k.ready.end(), later_deadline());
+				job* j = k.ready.back();
+				k.ready.pop_back();
+				k.served_at = now;
+				return j;
+			}
+			void work()
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while (!m_stopped)
+				{
+					time_point now = clock::now();
+					release(now);
+					bool promoted;
+					job* j = pick(now, promoted);
+					if (!j)
+					{
+						if (m_timed.empty()) m_changed.wait(lock);
+						else                 m_changed.wait_until(lock, time_point(m_timed.front()->release)); // copy: the job may be released meanwhile
+						continue;
+					}
+					j->running = true;
+					lock.unlock();
+
+					klass& k = m_state[j->priority];
+					time_point start = clock::now();
+					try
+					{
+						j->cb();
+					}
+					catch (...)
+					{
+						k.failures.fetch_add(1, std::memory_order_relaxed);
+					}
+					time_point end = clock::now();
+					k.runs.fetch_add(1, std::memory_order_relaxed);
+					if (promoted) k.promoted.fetch_add(1, std::memory_order_relaxed);
+					if (end > j->deadline) k.misses.fetch_add(1, std::memory_order_relaxed);
+					k.latency .record(nanoseconds(start - j->release));
+					k.lateness.record(nanoseconds(end - j->deadline));
+
+					lock.lock();
+					j->running = false;
+					m_finished.notify_all();
+					if (j->period > clock::duration::zero() && !j->cancelled)
+					{
+						j->release += j->period;
+						if (j->release < end) j->release += (end - j->release) / j->period * j->period + j->period; // skip missed periods
+						j->deadline = j->release + j->period;
+						m_timed.push_back(j);
+						std::push_heap(m_timed.begin(), m_timed.end(), later_release());
+						m_changed.notify_one();
+					}
+					else
+					{
+						drop(j);
+					}
+				}
+			}
+
+		private:
+			const std::vector<priority_class>    m_classes;
+			std::vector<klass>                   m_state;
+			mutable std::mutex                   m_mutex;
+			std::condition_variable              m_changed;
+			std::condition_variable              m_finished; // a run completed, for `cancel(id, true)`
+			std::vector<job*>                    m_timed; // heap on release
+			std::unordered_map<job_id, job*>     m_jobs;  // queued (timed or ready) or running, by id
+			job_id                               m_next_id = 1;
+			bool                                 m_stopped = false;
+			std::vector<std::unique_ptr<Worker>> m_workers;
+	};
+
+	/**
+	 * Pulser ticking every `period` on a TickScheduler worker instead of a
+	 * thread of its own. `start()` submits the periodic job in class
+	 * `priority`, `interrupt()` cancels it and `join()` waits for a tick in
+	 * progress. Ticks are released on the scheduler's real time clock.
+	 */
+	template<class I>
+	class ScheduledPulser : public PulserBase<>
+	{
+		public:
+			using interval = I;
+
+		public:
+			ScheduledPulser(TickScheduler& _scheduler, std::size_t _priority, const interval& _period)
+			: m_scheduler(_scheduler)
+			, m_priority(_priority)
+			, m_period(_period)
+			{
+			}
+			~ScheduledPulser()
+			{
+				interrupt();
+				join();
+			}
+			void start() override
+			{
+				m_interrupted = false;
+				m_job = m_scheduler.every(m_priority, m_period, [this]{ pulse(); });
+			}
+			void interrupt() override
+			{
+				m_interrupted = true;
+				if (auto job = m_job.load()) m_scheduler.cancel(job);
+			}
+			void join() override
+			{
+				if (auto job = m_job.load()) m_scheduler.cancel(job, true);
+				m_job = 0;
+			}
+			void detach() override
+			{
+				m_job = 0; // keeps ticking until the scheduler stops
+			}
+			bool active() override
+			{
+				return m_job.load() != 0;
+			}
+			bool finished() const override
+			{
+				auto job = m_job.load();
+				return !job || !m_scheduler.pending(job);
+			}
+
+		private:
+			void run() final
+			{
+			}
+
+		private:
+			TickScheduler&                     m_scheduler;
+			std::size_t                        m_priority;
+			interval                           m_period;
+			std::atomic<TickScheduler::job_id> m_job = 0; // read by `finished()` from other threads
+	};
+
+}
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef SEQLOCK_HH
+#define SEQLOCK_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "queue.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                                  Utils                                  */
+	/***************************************************************************/
+	namespace detail
+	{
+		/**
+		 * Trivially copyable value stored as atomic words, so a reader racing
+		 * with the writer gets a torn copy (detected by the caller) rather than
+		 * a data race
+		 */
+		template<class T>
+		class atomic_words
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "seqlock values must be trivially copyable");
+
+			public:
+				using word = std::uint64_t;
+				static constexpr std::size_t count = (sizeof(T) + sizeof(word) - 1) / sizeof(word);
+
+			public:
+				void store(const T& value)
+				{
+					word buffer[count] = {};
+					std::memcpy(buffer, &value, sizeof(T));
+					for (std::size_t i = 0; i < count; ++i) m_words[i].store(buffer[i], std::memory_order_relaxed);
+				}
+				void load(T& value) const
+				{
+					word buffer[count];
+					for (std::size_t i = 0; i < count; ++i) buffer[i] = m_words[i].load(std::memory_order_relaxed);
+					std::memcpy(&value, buffer, sizeof(T));
+				}
+
+			private:
+				std::atomic<word> m_words[count] = {};
+		};
+	}
+
+	/***************************************************************************/
+	/*                                 Seqlock                                 */
+	/***************************************************************************/
+	/**
+	 * Single writer, many readers. The writer never blocks: it makes the
+	 * sequence odd, writes, and makes it even again. Readers copy the value
+	 * and retry if the sequence was odd or changed meanwhile; they write no
+	 * shared memory, so any number of them can read without bouncing cache
+	 * lines. Suited to small state a pulser recomputes every tick.
+	 */
+	template<class T>
+	class seqlock
+	{
+		public:
+			using value_type = T;
+
+		public:
+			seqlock(const T& _initial = T())
+			{
+				m_value.store(_initial);
+			}
+			seqlock(const seqlock&) = delete;
+			seqlock& operator=(const seqlock&) = delete;
+
+			/**
+			 * Writer side (one thread at a time)
+			 */
+			void store(const T& value)
+			{
+				std::uint64_t sequence = m_sequence.load(std::memory_order_relaxed);
+				m_sequence.store(sequence + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				m_value.store(value);
+				m_sequence.store(sequence + 2, std::memory_order_release);
+			}
+
+			/**
+			 * Reader side: consistent copy of the last stored value
+			 */
+			T load() const
+			{
+				T value;
+				while (!try_load(value));
+				return value;
+			}
+			/**
+			 * Single attempt, false if it raced with a store
+			 */
+			bool try_load(T& value) const
+			{
+				std::uint64_t before = m_sequence.load(std::memory_order_acquire);
+				if (before & 1) return false;
+				m_value.load(value);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				return m_sequence.load(std::memory_order_relaxed) == before;
+			}
+			/**
+			 * Number of completed stores
+			 */
+			std::uint64_t version() const
+			{
+				return m_sequence.load(std::memory_order_acquire) / 2;
+			}
+
+		private:
+			alignas(cache_line) std::atomic<std::uint64_t> m_sequence = 0;
+			detail::atomic_words<T>                        m_value;
+	};
+
+	/***************************************************************************/
+	/*                            Versioned seqlock                            */
+	/***************************************************************************/
+	/**
+	 * Seqlock spread over `Slots` copies: each store goes to the slot after
+	 * the published one, then publishes it. Readers go to the published slot,
+	 * which the writer only touches again `Slots - 1` stores later, so they
+	 * practically never retry even when the writer is fast or the value large.
+	 * Each slot sits on its own cache lines. A slot's sequence is twice the
+	 * version it holds (minus one while it is written): readers retry unless
+	 * the slot still holds the version they started from, so the version
+	 * returned is the one of the value copied even if the writer wrapped
+	 * around to the same slot meanwhile.
+	 */
+	template<class T, std::size_t Slots = 4>
+	class versioned
+	{
+		static_assert(Slots >= 2, "versioned needs at least two slots");
+
+		public:
+			using value_type = T;
+
+		public:
+			versioned(const T& _initial = T())
+			{
+				m_slots[0].value.store(_initial);
+			}
+			versioned(const versioned&) = delete;
+			versioned& operator=(const versioned&) = delete;
+
+			/**
+			 * Writer side (one thread at a time)
+			 */
+			void store(const T& value)
+			{
+				std::uint64_t version = m_version.load(std::memory_order_relaxed) + 1;
+				slot& s = m_slots[version % Slots];
+				s.sequence.store(2 * version - 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				s.value.store(value);
+				s.sequence.store(2 * version, std::memory_order_release);
+				m_version.store(version, std::memory_order_release);
+			}
+
+			/**
+			 * Reader side: copies the latest value, returns its version
+			 */
+			std::uint64_t load(T& value) const
+			{
+				for (;;)
+				{
+					std::uint64_t version = m_version.load(std::memory_order_acquire);
+					const slot& s = m_slots[version % Slots];
+					if (s.sequence.load(std::memory_order_acquire) != 2 * version) continue; // being rewritten for a later version
+					s.value.load(value);
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (s.sequence.load(std::memory_order_relaxed) == 2 * version) return version;
+				}
+			}
+			T load() const
+			{
+				T value;
+				load(value);
+				return value;
+			}
+			std::uint64_t version() const
+			{
+				return m_version.load(std::memory_order_acquire);
+			}
+
+		private:
+			struct alignas(cache_line) slot
+			{
+				std::atomic<std::uint64_t> sequence = 0;
+				detail::atomic_words<T>    value;
+			};
+
+		private:
+			alignas(cache_line) std::atomic<std::uint64_t> m_version = 0;
+			slot                                           m_slots[Slots];
+	};
+
+}
+
+#endif
@@ -1,7 +1,11 @@
 #ifndef SINGLETON_HH
 #define SINGLETON_HH
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 template<typename T>
 class Singleton
@@ -38,4 +42,116 @@ class Singleton
 };
 template<typename T> std::unique_ptr<T> Singleton<T>::_singleton = nullptr;
 
+/**
+ * Singleton whose instance can be replaced while other threads are using it.
+ *
+ * Readers pin the current instance with `get()`, which returns a `snapshot`
+ * holding it alive until destroyed. Pinning costs two atomic increments and
+ * never locks. `replace()` publishes a new instance atomically, then waits for
+ * a grace period (every snapshot taken before the swap is released) before
+ * destroying the old one.
+ *
+ * The grace period uses two reader counters selected by the parity of an
+ * epoch: a writer flips the epoch and waits for the counter of the previous
+ * parity to drain. Do not call `replace()` or `kill()` while holding a
+ * snapshot on the same thread, it would wait for itself.
+ */
+template<typename T>
+class HotSwapSingleton
+{
+	protected:
+		HotSwapSingleton () = default;
+		~HotSwapSingleton() = default;
+	public:
+		class snapshot
+		{
+			public:
+				snapshot(snapshot&& other)
+				: m_instance(other.m_instance)
+				, m_readers(other.m_readers)
+				{
+					other.m_readers = nullptr;
+				}
+				snapshot(const snapshot&) = delete;
+				snapshot& operator=(const snapshot&) = delete;
+				snapshot& operator=(snapshot&&) = delete;
+				~snapshot()
+				{
+					if (m_readers) m_readers->fetch_sub(1);
+				}
+				const T& operator* () const { return *m_instance; }
+				const T* operator->() const { return  m_instance; }
+				const T* get       () const { return  m_instance; }
+			private:
+				friend class HotSwapSingleton;
+				snapshot(const T* instance, std::atomic<std::size_t>* readers)
+				: m_instance(instance)
+				, m_readers(readers)
+				{
+				}
+			private:
+				const T*                  m_instance;
+				std::atomic<std::size_t>* m_readers;
+		};
+
+	public:
+		template<class... Args>
+		static void init(Args&&... args)
+		{
+			replace(std::forward<Args>(args)...);
+		}
+		template<class... Args>
+		static void replace(Args&&... args)
+		{
+			swap(new T(std::forward<Args>(args)...));
+		}
+		static snapshot get()
+		{
+			std::atomic<std::size_t>* readers;
+			for (;;)
+			{
+				std::size_t epoch = _epoch.load();
+				readers = &_readers[epoch & 1];
+				readers->fetch_add(1);
+				if (_epoch.load() == epoch) break; // a writer flipped meanwhile, retry
+				readers->fetch_sub(1);
+			}
+			snapshot pinned(_current.load(), readers);
+			if (!pinned.get())
+			{
+				// ERROR: cannot use unitialized singleton
+				throw std::runtime_error("ERROR: Access to unitialized object.");
+			}
+			return pinned;
+		}
+		static bool initialized()
+		{
+			return _current.load() != nullptr;
+		}
+		static void kill()
+		{
+			swap(nullptr);
+		}
+	protected:
+		static void swap(T* fresh)
+		{
+			std::lock_guard<std::mutex> lock(_writer);
+			T* old = _current.exchange(fresh);
+			// grace period: readers that may still see `old` pinned the current parity
+			std::size_t epoch = _epoch.load();
+			_epoch.store(epoch + 1);
+			while (_readers[epoch & 1].load()) std::this_thread::yield();
+			delete old;
+		}
+	protected:
+		static std::atomic<T*>          _current;
+		static std::atomic<std::size_t> _epoch;
+		static std::atomic<std::size_t> _readers[2];
+		static std::mutex               _writer;
+};
+template<typename T> std::atomic<T*>          HotSwapSingleton<T>::_current{nullptr};
+template<typename T> std::atomic<std::size_t> HotSwapSingleton<T>::_epoch{0};
+template<typename T> std::atomic<std::size_t> HotSwapSingleton<T>::_readers[2] = {};
+template<typename T> std::mutex               HotSwapSingleton<T>::_writer;
+
 #endif
@@ -1,52 +1,139 @@
 #ifndef SYNC_HH
 #define SYNC_HH
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <system_error>
 #include <thread>
+#include <tuple>
 #include <vector>
 
+#include "clock.hh"
+#include "function.hh"
+#include "options.hh"
+#include "queue.hh"
+#include "trace.hh"
+#ifdef MADAG_SYNC_INSTRUMENTATION
+#include "histogram.hh"
+#endif
+
 namespace madag::sync
 {
 
 	/***************************************************************************/
 	/*                                  Utils                                  */
 	/***************************************************************************/
+	/**
+	 * Notification counters of a `notifiable`
+	 */
+	struct notify_stats
+	{
+		std::uint64_t notifications; // calls to `notify()`
+		std::uint64_t wakeups;       // successful `wait()` / `try_wait()`
+		std::uint64_t coalesced;     // notifications consumed by a wakeup besides the first
+	};
+
+	/**
+	 * Counting event: `notify()` adds one pending notification, `wait()`
+	 * blocks until there is one and consumes up to `max` of them at once,
+	 * returning how many. The default consumes them all (batching), `max = 1`
+	 * behaves like a semaphore.
+	 *
+	 * A thread blocking in `wait()` is parked on the `virtual_clock`, so it
+	 * does not stop automatic advance. A notification hands it back before
+	 * waking it. This costs a thread-local check when no test clock is in use.
+	 */
 	class notifiable
 	{
 		public:
 			void notify()
 			{
+				trace::instant("notify");
 				std::unique_lock<decltype(m_mutex)> lock(m_mutex);
-				m_wake = true;
+				if (!m_pending && m_parked)
+				{
+					--m_parked;
+					++m_handed;
+					virtual_clock::hand_over();
+				}
+				++m_pending;
+				++m_stats.notifications;
 				m_condition.notify_one();
 			}
-			void wait()
+			std::size_t wait(std::size_t max = std::numeric_limits<std::size_t>::max())
+			{
+				std::unique_lock<decltype(m_mutex)> lock(m_mutex);
+				if (!m_pending)
+				{
+					bool parked = virtual_clock::park();
+					m_parked += parked;
+					while (!m_pending) m_condition.wait(lock);
+					if (parked)
+					{
+						bool handed = m_handed > 0;
+						if (handed) --m_handed;
+						else        --m_parked;
+						virtual_clock::unpark(handed);
+					}
+				}
+				return consume(max);
+			}
+			/**
+			 * Returns the number of notifications consumed, 0 if none was pending
+			 */
+			std::size_t try_wait(std::size_t max = std::numeric_limits<std::size_t>::max())
 			{
 				std::unique_lock<decltype(m_mutex)> lock(m_mutex);
-				while (!m_wake) m_condition.wait(lock);
-				m_wake = false;
+				return m_pending ? consume(max) : 0;
 			}
-			bool try_wait()
+			std::size_t pending()
 			{
 				std::unique_lock<decltype(m_mutex)> lock(m_mutex);
-				bool result = m_wake;
-				m_wake = false;
+				return m_pending;
+			}
+			notify_stats stats(bool reset = false)
+			{
+				std::unique_lock<decltype(m_mutex)> lock(m_mutex);
+				notify_stats result = m_stats;
+				if (reset) m_stats = {};
 				return result;
 			}
 
+		private:
+			std::size_t consume(std::size_t max)
+			{
+				std::size_t count = m_pending < max ? m_pending : max;
+				m_pending -= count;
+				++m_stats.wakeups;
+				m_stats.coalesced += count - 1;
+				return count;
+			}
+
 		private:
 			std::mutex              m_mutex;
 			std::condition_variable m_condition;
-			bool                    m_wake = false;
+			std::size_t             m_pending = 0;
+			std::size_t             m_parked  = 0; // waiters parked on the virtual clock
+			std::size_t             m_handed  = 0; // of which already counted awake by `notify`
+			notify_stats            m_stats   = {};
 	};
 
 	/***************************************************************************/
 	/*                             Generic thread                              */
 	/***************************************************************************/
+	/**
+	 * Thread running the virtual `run()`. Options set with `configure()`
+	 * before `start()` (name, affinity, NUMA node, scheduling, stack size)
+	 * are applied by the new thread before `run()` executes; settings the
+	 * system refused are reported by `setup_error()`.
+	 */
 	template<class... Args>
 	class PolymorphicThread
 	{
@@ -54,22 +141,116 @@ namespace madag::sync
 			virtual ~PolymorphicThread() = default;
 			virtual void start (Args&&... args)
 			{
-				m_thread = std::thread(&PolymorphicThread::run, this, std::forward<Args>(args)...);
+				m_finished = false;
+				auto body = [this](Args... _args)
+				{
+					m_setup_error = m_options.apply();
+					trace::name_thread(m_options.name);
+					std::atomic<bool>* finished = self_deleting() ? nullptr : &m_finished;
+					trace::begin("run");
+					run(std::move(_args)...); // may delete this
+					trace::end("run");
+					if (finished) finished->store(true, std::memory_order_release);
+				};
+				if (m_options.stack_size) launch(body, std::forward<Args>(args)...);
+				else                      m_thread = std::thread(body, std::forward<Args>(args)...);
 			}
-			virtual void join  () { m_thread.join();            }
-			virtual void detach() { m_thread.detach();          }
-			virtual bool active() { return m_thread.joinable(); }
+			virtual void join  () { if (m_native) { pthread_join  (*m_native, nullptr); m_native.reset(); } else m_thread.join();   }
+			virtual void detach() { if (m_native) { pthread_detach(*m_native);          m_native.reset(); } else m_thread.detach(); }
+			virtual bool active() { return m_native || m_thread.joinable(); }
+			/**
+			 * `run()` returned (joining will not block)
+			 */
+			virtual bool finished() const { return m_finished.load(std::memory_order_acquire); }
+
+			void configure(const thread_options& options) { m_options = options; }
+			const thread_options& options() const        { return m_options;    }
+			int setup_error() const                      { return m_setup_error; }
+			/**
+			 * Whether `run()` deletes the object, which must not be touched after
+			 */
+			virtual bool self_deleting() const { return false; }
 
 		protected:
 			virtual void run(Args... args) = 0;
 
 		private:
-			std::thread m_thread;
+			/**
+			 * std::thread cannot set a stack size, go through pthreads
+			 */
+			template<class Body>
+			void launch(Body body, Args&&... args)
+			{
+				auto task = [body, arguments = std::make_tuple(std::forward<Args>(args)...)]() mutable
+				{
+					std::apply(body, std::move(arguments));
+				};
+				using Task = decltype(task);
+				auto owned = std::make_unique<Task>(std::move(task));
+				pthread_attr_t attributes;
+				pthread_attr_init(&attributes);
+				int error = pthread_attr_setstacksize(&attributes, m_options.stack_size);
+				pthread_t handle;
+				if (!error)
+				{
+					error = pthread_create(&handle, &attributes, [](void* p) -> void*
+					{
+						std::unique_ptr<Task>(static_cast<Task*>(p))->operator()();
+						return nullptr;
+					}, owned.get());
+				}
+				pthread_attr_destroy(&attributes);
+				if (error) throw std::system_error(error, std::generic_category(), "PolymorphicThread::start");
+				owned.release();
+				m_native = std::make_unique<pthread_t>(handle);
+			}
+
+		private:
+			std::thread                m_thread;
+			std::unique_ptr<pthread_t> m_native;
+			thread_options             m_options;
+			std::atomic<int>           m_setup_error = 0;
+			std::atomic<bool>          m_finished    = false;
 	};
 
 	/***************************************************************************/
 	/*                Pulsers (ticking threads, interruptable)                 */
 	/***************************************************************************/
+#ifdef MADAG_SYNC_INSTRUMENTATION
+	/**
+	 * Tick measurements of a pulser, all durations in nanoseconds
+	 */
+	struct pulser_stats
+	{
+		std::uint64_t      ticks;
+		std::uint64_t      overruns;     // ticks that lasted longer than their period
+		histogram_snapshot lateness;     // actual tick start minus scheduled start
+		histogram_snapshot duration;     // time spent in `tick()`
+		histogram_snapshot wake_latency; // first notification to tick start
+	};
+#endif
+
+	/**
+	 * Last tick boundaries of a pulser, in nanoseconds of the steady clock
+	 * (0 before the first watched tick). A tick is running while `tick_start`
+	 * is greater than `tick_end`, which only tells whether the tick completed:
+	 * it equals `tick_start` afterwards.
+	 */
+	struct heartbeat
+	{
+		std::int64_t tick_start;
+		std::int64_t tick_end;
+	};
+
+	/**
+	 * Pulsers call `tick()` through `pulse()`. While a watchdog tracks the
+	 * pulser (`track_heartbeat()`), `pulse()` publishes the tick start read by
+	 * `last_heartbeat()`: one clock read and two relaxed stores per tick,
+	 * otherwise a single relaxed load. When
+	 * MADAG_SYNC_INSTRUMENTATION is defined (identically in every translation
+	 * unit) it also records timings into lock-free histograms readable with
+	 * `stats()`.
+	 */
 	template<class... Args>
 	class PulserBase : public PolymorphicThread<Args...>
 	{
@@ -78,23 +259,147 @@ namespace madag::sync
 			: m_interrupted(false)
 			{
 			}
-			virtual void interrupt() { m_interrupted = true; }
+			/**
+			 * Clears a previous interruption, so a joined pulser can run again
+			 */
+			void start(Args&&... args) override
+			{
+				m_interrupted = false;
+				m_interrupter.reset();
+				PolymorphicThread<Args...>::start(std::forward<Args>(args)...);
+			}
+			/**
+			 * Stop after the current tick, cutting short any sleep in progress
+			 */
+			virtual void interrupt()
+			{
+				m_interrupted = true;
+				m_interrupter.raise();
+			}
+#ifdef MADAG_SYNC_INSTRUMENTATION
+			pulser_stats stats(bool reset = false)
+			{
+				return {
+					reset ? m_ticks   .exchange(0, std::memory_order_relaxed) : m_ticks   .load(std::memory_order_relaxed),
+					reset ? m_overruns.exchange(0, std::memory_order_relaxed) : m_overruns.load(std::memory_order_relaxed),
+					m_lateness    .snapshot(reset),
+					m_duration    .snapshot(reset),
+					m_wake_latency.snapshot(reset),
+				};
+			}
+#endif
+			/**
+			 * Start or stop publishing heartbeats, calls nest
+			 */
+			void track_heartbeat(bool enable) const
+			{
+				if (enable) m_watchers.fetch_add(1, std::memory_order_relaxed);
+				else        m_watchers.fetch_sub(1, std::memory_order_relaxed);
+			}
+			heartbeat last_heartbeat() const
+			{
+				std::int64_t beat = m_heartbeat.load(std::memory_order_relaxed);
+				if (beat < 0) return { -beat, -beat };
+				return { beat, 0 };
+			}
 
 		protected:
 			virtual void tick() = 0;
+			/**
+			 * Current time of the clock policy `C` for instrumentation purposes
+			 * (0 when disabled)
+			 */
+			template<class C = steady_sleeper>
+			static std::int64_t instrument_now()
+			{
+#ifdef MADAG_SYNC_INSTRUMENTATION
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(C::now().time_since_epoch()).count();
+#else
+				return 0;
+#endif
+			}
+			static std::int64_t heartbeat_now()
+			{
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+			/**
+			 * Run one tick. `due` is when it was scheduled (from
+			 * `instrument_now<C>`, 0 if unscheduled), ticks longer than a
+			 * non-zero `budget` count as overruns. Lateness is measured on the
+			 * clock policy `C` the pulser sleeps on, durations in real time.
+			 */
+			template<class C = steady_sleeper, class Budget = std::chrono::nanoseconds>
+			void pulse(std::int64_t due = 0, const Budget& budget = Budget::zero())
+			{
+#ifdef MADAG_SYNC_INSTRUMENTATION
+				trace::scope traced("tick");
+				std::int64_t start = instrument_now();
+				bool watched = m_watchers.load(std::memory_order_relaxed);
+				if (watched) m_heartbeat.store(start, std::memory_order_relaxed);
+				if (due)
+				{
+					std::int64_t started = instrument_now<C>();
+					m_lateness.record(started > due ? std::uint64_t(started - due) : 0);
+				}
+				std::int64_t notified = m_notified_at.exchange(0, std::memory_order_relaxed);
+				if (notified) m_wake_latency.record(start > notified ? std::uint64_t(start - notified) : 0);
+				tick();
+				std::int64_t end = instrument_now();
+				if (watched) m_heartbeat.store(-start, std::memory_order_relaxed);
+				std::int64_t duration = end - start;
+				m_duration.record(std::uint64_t(duration));
+				m_ticks.fetch_add(1, std::memory_order_relaxed);
+				if (budget != Budget::zero() && std::chrono::nanoseconds(duration) > budget)
+				{
+					m_overruns.fetch_add(1, std::memory_order_relaxed);
+				}
+#else
+				(void)due; (void)budget;
+				trace::scope traced("tick");
+				if (!m_watchers.load(std::memory_order_relaxed)) return tick();
+				std::int64_t start = heartbeat_now();
+				m_heartbeat.store(start, std::memory_order_relaxed);
+				tick();
+				m_heartbeat.store(-start, std::memory_order_relaxed);
+#endif
+			}
+			/**
+			 * Remember when the first notification since the last tick arrived
+			 */
+			void notified()
+			{
+#ifdef MADAG_SYNC_INSTRUMENTATION
+				std::int64_t none = 0;
+				m_notified_at.compare_exchange_strong(none, instrument_now(), std::memory_order_relaxed);
+#endif
+			}
 
 		protected:
 			std::atomic<bool> m_interrupted;
+			interrupter       m_interrupter; // pass to the clock policy's sleeps
+		private:
+			std::atomic<std::int64_t>     m_heartbeat = 0; // start of the running tick, negated once it completed
+			mutable std::atomic<unsigned> m_watchers  = 0;
+#ifdef MADAG_SYNC_INSTRUMENTATION
+		private:
+			std::atomic<std::uint64_t> m_ticks       = 0;
+			std::atomic<std::uint64_t> m_overruns    = 0;
+			std::atomic<std::int64_t>  m_notified_at = 0;
+			histogram<>                m_lateness;
+			histogram<>                m_duration;
+			histogram<>                m_wake_latency;
+#endif
 	};
 
 	/**
 	 * Pulses regularly (clock)
 	 */
-	template<class I>
+	template<class I, class C = steady_sleeper>
 	class ClockPulser : public PulserBase<>
 	{
 		public:
 			using interval = I;
+			using clock    = C;
 
 		public:
 			ClockPulser(const interval& _interval)
@@ -107,9 +412,10 @@ namespace madag::sync
 			{
 				while (true)
 				{
-					std::this_thread::sleep_for(m_interval);
+					std::int64_t due = instrument_now<clock>() + std::chrono::duration_cast<std::chrono::nanoseconds>(m_interval).count();
+					clock::sleep_for(m_interval, m_interrupter);
 					if (m_interrupted) { break; }
-					tick();
+					pulse<clock>(due, m_interval);
 				}
 			}
 
@@ -185,6 +491,9 @@ namespace madag::sync
 
 	/**
 	 * Pulses based on notification (killed by interrupt)
+	 *
+	 * Notifications arriving before the thread wakes up are folded into one
+	 * tick, `notifications()` tells `tick()` how many it is handling.
 	 */
 	class NotifiedPulser : public madag::sync::PulserBase<>
 	{
@@ -199,94 +508,419 @@ namespace madag::sync
 			{
 				for (;;)
 				{
-					m_notifiablelock.wait();
+					m_notifications = m_notifiablelock.wait();
 					if (m_interrupted) { break; }
-					tick();
+					pulse();
 				}
 			}
 		public:
+			notify_stats notification_stats(bool reset = false) { return m_notifiablelock.stats(reset); }
+			/**
+			 * Drops the notifications left from a previous run (such as the
+			 * one sent by `interrupt()`), so a restarted pulser only ticks on
+			 * new wakeups
+			 */
+			void start() override
+			{
+				while (m_notifiablelock.try_wait());
+				PulserBase::start();
+			}
 			void wakeup()
 			{
+				notified();
 				m_notifiablelock.notify();
 			}
+			void interrupt() override
+			{
+				PulserBase::interrupt();
+				m_notifiablelock.notify(); // Needed for the thread to break
+			}
 			void kill()
 			{
 				interrupt();
-				wakeup(); // Needed for the thread to break
 			}
 		protected:
-			notifiable m_notifiablelock;
+			/**
+			 * Notifications handled by the current tick
+			 */
+			std::size_t notifications() const { return m_notifications; }
+
+		protected:
+			notifiable  m_notifiablelock;
+			std::size_t m_notifications = 0;
 	};
 
 	/**
-	 * Pulses based on notification with minimal delay between ticks
+	 * Pulses on batches of messages posted by any number of producers
+	 *
+	 * Messages derive from `mpsc_node` and are linked into a lock-free queue.
+	 * Only a post into an empty mailbox wakes the thread, each tick then hands
+	 * every pending message to `receive` (which takes ownership). Messages left
+	 * in the mailbox when the pulser is destroyed are not released.
 	 */
+	template<class T>
+	class MailboxPulser : public NotifiedPulser
+	{
+		public:
+			using message = T;
+
+		public:
+			MailboxPulser(std::size_t _capacity = std::numeric_limits<std::size_t>::max())
+			: m_mailbox(_capacity)
+			{
+			}
+			/**
+			 * Returns false if the mailbox is full, ownership stays with the caller.
+			 */
+			bool post(message* _message)
+			{
+				switch (m_mailbox.push(_message))
+				{
+					case mpsc_push::full:   return false;
+					case mpsc_push::first:  wakeup(); break;
+					case mpsc_push::queued: break;
+				}
+				return true;
+			}
+			std::size_t pending() const { return m_mailbox.size(); }
+
+		protected:
+			virtual void receive(message* _message) = 0;
+
+		private:
+			void tick() final
+			{
+				m_mailbox.consume_all([this](message* _message){ receive(_message); });
+			}
+
+		private:
+			mpsc_queue<message> m_mailbox;
+	};
+
+	/**
+	 * How a DelayedNotifiedPulser spaces its ticks
+	 */
+	enum class throttling
+	{
+		fixed_delay,       // sleep `period` after every tick
+		token_bucket,      // up to `burst` immediate ticks, then one per `period`
+		debounce_leading,  // tick on the first notification, absorb the rest until `period` passes quietly
+		debounce_trailing, // tick once `period` passed quietly, or `max_latency` after the first notification
+		coalesce,          // tick immediately if the last tick is `max_latency` old, else wait until it is
+	};
+
 	template<class I>
+	struct throttle
+	{
+		throttling  mode;
+		I           period      = I::zero();
+		std::size_t burst       = 1;
+		I           max_latency = I::zero();
+
+		static throttle fixed_delay      (const I& delay)                       { return { throttling::fixed_delay,       delay                    }; }
+		static throttle token_bucket     (const I& period, std::size_t burst)   { return { throttling::token_bucket,      period, burst            }; }
+		static throttle debounce_leading (const I& window)                      { return { throttling::debounce_leading,  window                   }; }
+		static throttle debounce_trailing(const I& quiet, const I& max_latency) { return { throttling::debounce_trailing, quiet, 1, max_latency   }; }
+		static throttle coalesce         (const I& max_latency)                 { return { throttling::coalesce,          I::zero(), 1, max_latency }; }
+	};
+
+	/**
+	 * Pulses based on notification with minimal delay between ticks
+	 *
+	 * By default every tick is followed by a fixed sleep. The other
+	 * `throttling` modes only delay a tick when the recent ones require it,
+	 * so the pulser reacts immediately after a lull and batches under load.
+	 * Notifications received while waiting are folded into the next tick.
+	 */
+	template<class I, class C = steady_sleeper>
 	class DelayedNotifiedPulser : public NotifiedPulser
 	{
 		public:
 			using interval = I;
+			using clock    = C;
 
 		public:
 			DelayedNotifiedPulser(const interval& _delay)
-			: m_delay(_delay)
+			: m_throttle(throttle<interval>::fixed_delay(_delay))
+			{}
+			DelayedNotifiedPulser(const throttle<interval>& _throttle)
+			: m_throttle(_throttle)
 			{}
 		private:
 			void run()
 			{
-				for (;;)
+				const interval& period = m_throttle.period;
+				// token bucket: theoretical arrival time of the next tick (GCRA)
+				typename clock::time_point next = clock::now();
+				typename clock::time_point last = clock::now() - m_throttle.max_latency;
+				while (!m_interrupted) // a mode may have consumed the notification of `interrupt()`
 				{
-					m_notifiablelock.wait();
+					m_notifications = m_notifiablelock.wait();
 					if (m_interrupted) { break; }
-					tick();
-					std::this_thread::sleep_for(m_delay);
+					switch (m_throttle.mode)
+					{
+						case throttling::fixed_delay:
+							pulse();
+							clock::sleep_for(period, m_interrupter);
+							break;
+
+						case throttling::token_bucket:
+						{
+							auto earliest = next - period * typename interval::rep(m_throttle.burst ? m_throttle.burst - 1 : 0);
+							auto now      = clock::now();
+							if (now < earliest)
+							{
+								clock::sleep_until(earliest, m_interrupter);
+								now = earliest;
+							}
+							next = (next > now ? next : now) + period;
+							if (m_interrupted) { break; }
+							m_notifications += m_notifiablelock.try_wait();
+							pulse();
+							break;
+						}
+
+						case throttling::debounce_leading:
+							pulse();
+							do { clock::sleep_for(period, m_interrupter); }
+							while (!m_interrupted && m_notifiablelock.try_wait()); // absorbed, not ticked
+							break;
+
+						case throttling::debounce_trailing:
+						{
+							auto deadline = clock::now() + m_throttle.max_latency;
+							for (;;)
+							{
+								auto now = clock::now();
+								if (now >= deadline) break;
+								clock::sleep_until(now + period < deadline ? now + period : deadline, m_interrupter);
+								if (m_interrupted) break;
+								std::size_t more = m_notifiablelock.try_wait();
+								if (!more) break;
+								m_notifications += more;
+							}
+							if (m_interrupted) { break; }
+							pulse();
+							break;
+						}
+
+						case throttling::coalesce:
+						{
+							auto due = last + m_throttle.max_latency;
+							if (clock::now() < due)
+							{
+								clock::sleep_until(due, m_interrupter);
+								if (m_interrupted) { break; }
+								m_notifications += m_notifiablelock.try_wait();
+							}
+							last = clock::now();
+							pulse();
+							break;
+						}
+					}
 				}
 			}
 		private:
-			interval m_delay;
+			throttle<interval> m_throttle;
 	};
 
+	namespace detail
+	{
+		/**
+		 * Thread running the timers of one type: they wait in a heap ordered
+		 * by due time, sleeping on the clock policy until the earliest one.
+		 * Started on first use and stopped at exit; timers still pending then
+		 * are released without firing.
+		 */
+		template<class Timer, class C>
+		class timer_service
+		{
+			public:
+				using clock = C;
+
+			public:
+				static timer_service& instance()
+				{
+					static timer_service global;
+					return global;
+				}
+				void schedule(Timer* timer)
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_timers.push_back(timer);
+						std::push_heap(m_timers.begin(), m_timers.end(), later());
+					}
+					m_wake.raise();
+					m_pending.notify();
+				}
+				/**
+				 * An interrupted timer is waiting, release it now
+				 */
+				void sweep()
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_sweep = true;
+					}
+					m_wake.raise();
+					m_pending.notify();
+				}
+
+			private:
+				struct later { bool operator()(const Timer* a, const Timer* b) const { return a->m_due > b->m_due; } };
+
+				timer_service()
+				: m_thread([this]{ run(); })
+				{
+				}
+				~timer_service()
+				{
+					{
+						std::lock_guard<std::mutex> lock(m_mutex);
+						m_stopped = true;
+					}
+					m_wake.raise();
+					m_pending.notify();
+					m_thread.join();
+					for (Timer* timer : m_timers) delete timer;
+				}
+				void run()
+				{
+					trace::name_thread("timers");
+					std::unique_lock<std::mutex> lock(m_mutex);
+					while (!m_stopped)
+					{
+						if (m_sweep)
+						{
+							m_sweep = false;
+							auto kept = std::partition(m_timers.begin(), m_timers.end(), [](Timer* timer){ return !timer->m_interrupted; });
+							m_released.assign(kept, m_timers.end());
+							m_timers.erase(kept, m_timers.end());
+							std::make_heap(m_timers.begin(), m_timers.end(), later());
+						}
+						else if (m_timers.empty())
+						{
+							lock.unlock();
+							m_pending.wait();
+							lock.lock();
+							continue;
+						}
+						else if (clock::now() < m_timers.front()->m_due)
+						{
+							auto due = m_timers.front()->m_due;
+							m_wake.reset(); // raised again by any later schedule or sweep
+							lock.unlock();
+							clock::sleep_until(due, m_wake);
+							lock.lock();
+							continue;
+						}
+						else
+						{
+							std::pop_heap(m_timers.begin(), m_timers.end(), later());
+							m_released.assign(1, m_timers.back());
+							m_timers.pop_back();
+						}
+						// fire and release outside the lock: callbacks may schedule timers
+						lock.unlock();
+						for (Timer* timer : m_released)
+						{
+							timer->fire();
+							delete timer;
+						}
+						lock.lock();
+						m_released.clear();
+					}
+				}
+
+			private:
+				std::mutex          m_mutex;
+				std::vector<Timer*> m_timers;   // heap on due time
+				std::vector<Timer*> m_released; // taken out of the heap, owned by the service thread
+				bool                m_sweep   = false;
+				bool                m_stopped = false;
+				interrupter         m_wake;
+				notifiable          m_pending;
+				std::thread         m_thread;
+		};
+	}
+
 	/**
 	 * Pulses once with lambda (interruptable)
+	 *
+	 * The callback is stored inline, timers are recycled through a pool and
+	 * all timers of a type share one thread (`detail::timer_service`), so
+	 * scheduling one does not allocate once warmed up. Interrupting a pending
+	 * timer releases it without calling the callback.
 	 */
-	template<class I>
+	template<class I, class C = steady_sleeper>
 	class SelfDeletingTimer : public PulserBase<>
 	{
 		public:
-			using callable = std::function<void(void)>;
+			using callable = inplace_function<void(void), 64>;
 			using interval = I;
+			using clock    = C;
 			using instance = SelfDeletingTimer*;
 
 		private:
+			friend class detail::timer_service<SelfDeletingTimer, C>;
+			using service = detail::timer_service<SelfDeletingTimer, C>;
+
 			SelfDeletingTimer(const interval& _interval, callable&& _callback)
 			: m_interval(_interval)
-			, m_callback(_callback)
+			, m_callback(std::move(_callback))
 			{
 			}
+			/**
+			 * Timers do not get a thread of their own, `start()` hands them to
+			 * the service
+			 */
 			void run() final
 			{
-				std::this_thread::sleep_for(m_interval);
-				if (!m_interrupted) tick();
-				delete this;
+			}
+			void fire()
+			{
+				if (m_interrupted) return;
+				pulse<clock>(std::chrono::duration_cast<std::chrono::nanoseconds>(m_due.time_since_epoch()).count());
 			}
 			void tick()
 			{
 				m_callback();
 			}
 		public:
-			void start()
+			bool self_deleting() const final
 			{
-				PolymorphicThread::start();
-				PolymorphicThread::detach();
+				return true;
+			}
+			void start() override
+			{
+				m_due = clock::now() + std::chrono::duration_cast<typename clock::duration>(m_interval);
+				service::instance().schedule(this);
+			}
+			void interrupt() override
+			{
+				m_interrupted = true; // last access: the service may release the timer from now on
+				service::instance().sweep();
 			}
 			static
 			SelfDeletingTimer* factory(const interval& _interval, callable&& _callback)
 			{
 				return new SelfDeletingTimer(_interval, std::forward<callable&&>(_callback));
 			}
+			static void* operator new(std::size_t size)
+			{
+				if (size != sizeof(SelfDeletingTimer)) return ::operator new(size);
+				return block_pool<sizeof(SelfDeletingTimer)>::allocate();
+			}
+			static void operator delete(void* block, std::size_t size)
+			{
+				if (size != sizeof(SelfDeletingTimer)) return ::operator delete(block);
+				block_pool<sizeof(SelfDeletingTimer)>::deallocate(block);
+			}
 		private:
-			interval m_interval;
-			callable m_callback;
+			interval                   m_interval;
+			callable                   m_callback;
+			typename clock::time_point m_due;
 	};
 
 }
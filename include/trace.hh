@@ -0,0 +1,288 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Timeline of thread, tick and notification activity for madag::sync.
+ *
+ * When MADAG_SYNC_TRACE is defined (identically in every translation unit),
+ * each thread records events into its own lock-free ring buffer and `dump`
+ * writes them as Chrome trace JSON, which chrome://tracing and the Perfetto
+ * UI both open. Otherwise every recording function is an empty inline.
+ */
+namespace madag::sync::trace
+{
+
+#ifdef MADAG_SYNC_TRACE
+	/***************************************************************************/
+	/*                            Per-thread buffers                           */
+	/***************************************************************************/
+	/**
+	 * Ring of the most recent events of one thread. Only the owning thread
+	 * writes; readers copy it concurrently and discard slots that may have
+	 * been overwritten while they were reading. The head works as the
+	 * sequence word of a seqlock: it is published before the slot writes of
+	 * the next event, so a reader that saw any of them also sees the head
+	 * that invalidates the slot.
+	 */
+	class buffer
+	{
+		public:
+			static constexpr std::size_t capacity = 4096;
+
+			struct event
+			{
+				std::uint64_t timestamp; // ns, steady clock
+				const char*   name;
+				char          phase;     // 'B'egin, 'E'nd, 'i'nstant
+			};
+
+		public:
+			buffer(std::uint64_t _tid)
+			: m_tid(_tid)
+			{
+			}
+			void record(char phase, const char* name)
+			{
+				std::uint64_t head = m_head.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release); // order the previous head before the slot writes
+				slot& s = m_slots[head % capacity];
+				s.timestamp.store(now(), std::memory_order_relaxed);
+				s.name     .store(name,  std::memory_order_relaxed);
+				s.phase    .store(phase, std::memory_order_relaxed);
+				m_head.store(head + 1, std::memory_order_release);
+			}
+			std::vector<event> events() const
+			{
+				std::uint64_t head  = m_head.load(std::memory_order_acquire);
+				std::uint64_t first = head > capacity ? head - capacity : 0;
+				std::vector<event> result;
+				result.reserve(head - first);
+				for (std::uint64_t i = first; i < head; ++i)
+				{
+					const slot& s = m_slots[i % capacity];
+					result.push_back({
+						s.timestamp.load(std::memory_order_relaxed),
+						s.name     .load(std::memory_order_relaxed),
+						s.phase    .load(std::memory_order_relaxed),
+					});
+				}
+				// the writer may be rewriting slots (head - capacity + 1) onwards
+				std::atomic_thread_fence(std::memory_order_acquire);
+				std::uint64_t now  = m_head.load(std::memory_order_relaxed);
+				std::uint64_t safe = now + 1 > capacity ? now + 1 - capacity : 0;
+				if (safe > first) result.erase(result.begin(), result.begin() + std::min(safe - first, result.size()));
+				return result;
+			}
+			std::uint64_t tid() const { return m_tid; }
+
+			static std::uint64_t now()
+			{
+				return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+			}
+
+		public:
+			std::string       name;           // guarded by the registry mutex
+			std::atomic<bool> alive = true;
+
+		private:
+			struct slot
+			{
+				std::atomic<std::uint64_t> timestamp = 0;
+				std::atomic<const char*>   name      = nullptr;
+				std::atomic<char>          phase     = 0;
+			};
+			const std::uint64_t         m_tid;
+			std::atomic<std::uint64_t>  m_head = 0;
+			std::array<slot, capacity>  m_slots;
+	};
+
+	/**
+	 * Buffers of the running threads, and of exited ones until a dump wrote
+	 * them out. At most `max_exited` exited buffers are kept waiting for a
+	 * dump, the oldest are released first, so memory stays bounded when
+	 * short-lived threads come and go.
+	 */
+	class registry
+	{
+		public:
+			static constexpr std::size_t max_exited = 64;
+
+		public:
+			static registry& instance()
+			{
+				static registry global;
+				return global;
+			}
+			std::shared_ptr<buffer> create()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_buffers.push_back(std::make_shared<buffer>(++m_tids));
+				return m_buffers.back();
+			}
+			void rename(buffer& b, const std::string& name)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				b.name = name;
+			}
+			/**
+			 * Called by the owning thread when it exits
+			 */
+			void retire(buffer& b)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				b.alive = false;
+				std::size_t exited = 0;
+				for (auto& other : m_buffers) exited += !other->alive;
+				if (exited <= max_exited) return;
+				auto oldest = std::find_if(m_buffers.begin(), m_buffers.end(), [](auto& other){ return !other->alive; });
+				m_buffers.erase(oldest);
+			}
+			/**
+			 * Drop the buffers of exited threads
+			 */
+			void clear()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(), [](auto& b){ return !b->alive; }), m_buffers.end());
+			}
+			/**
+			 * Write every buffer out, then release those of threads that had
+			 * already exited: their events will not be written again
+			 */
+			void dump(std::ostream& out)
+			{
+				std::vector<std::shared_ptr<buffer>> buffers;
+				std::vector<std::string>             names;
+				std::vector<std::shared_ptr<buffer>> drained;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					buffers = m_buffers;
+					for (auto& b : buffers)
+					{
+						names.push_back(b->name);
+						if (!b->alive) drained.push_back(b);
+					}
+				}
+				out << "{\"traceEvents\":[";
+				const char* separator = "\n";
+				for (std::size_t i = 0; i < buffers.size(); ++i)
+				{
+					if (!names[i].empty())
+					{
+						out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffers[i]->tid()
+						    << ",\"args\":{\"name\":\"";
+						escape(out, names[i].c_str());
+						out << "\"}}";
+						separator = ",\n";
+					}
+					for (const buffer::event& e : buffers[i]->events())
+					{
+						out << separator << "{\"name\":\"";
+						escape(out, e.name);
+						out << "\",\"cat\":\"madag\",\"ph\":\"" << e.phase << '"'
+						    << (e.phase == 'i' ? ",\"s\":\"t\"" : "")
+						    << ",\"ts\":" << e.timestamp / 1000 << '.' << char('0' + e.timestamp / 100 % 10)
+						    << char('0' + e.timestamp / 10 % 10) << char('0' + e.timestamp % 10)
+						    << ",\"pid\":1,\"tid\":" << buffers[i]->tid() << '}';
+						separator = ",\n";
+					}
+				}
+				out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				release_exited(drained);
+			}
+
+		private:
+			/**
+			 * Remove the exited buffers among `candidates` (mutex held)
+			 */
+			void release_exited(const std::vector<std::shared_ptr<buffer>>& candidates)
+			{
+				m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(), [&](auto& b)
+				{
+					return !b->alive && std::find(candidates.begin(), candidates.end(), b) != candidates.end();
+				}), m_buffers.end());
+			}
+			/**
+			 * JSON string contents
+			 */
+			static void escape(std::ostream& out, const char* text)
+			{
+				static const char hex[] = "0123456789abcdef";
+				for (const char* c = text ? text : ""; *c; ++c)
+				{
+					unsigned char u = static_cast<unsigned char>(*c);
+					if      (u == '"' || u == '\\') out << '\\' << *c;
+					else if (u < 0x20)             out << "\\u00" << hex[u >> 4] << hex[u & 0xf];
+					else                           out << *c;
+				}
+			}
+
+		private:
+			std::mutex                           m_mutex;
+			std::vector<std::shared_ptr<buffer>> m_buffers;
+			std::uint64_t                        m_tids = 0;
+	};
+
+	/**
+	 * Buffer of the calling thread, registered on first use
+	 */
+	inline buffer& local()
+	{
+		struct owner
+		{
+			std::shared_ptr<buffer> b = registry::instance().create();
+			~owner() { registry::instance().retire(*b); }
+		};
+		thread_local owner current;
+		return *current.b;
+	}
+
+	/***************************************************************************/
+	/*                                Recording                                */
+	/***************************************************************************/
+	inline void begin  (const char* name) { local().record('B', name); }
+	inline void end    (const char* name) { local().record('E', name); }
+	inline void instant(const char* name) { local().record('i', name); }
+	inline void name_thread(const std::string& name) { registry::instance().rename(local(), name); }
+	inline void clear() { registry::instance().clear(); }
+	inline void dump(std::ostream& out) { registry::instance().dump(out); }
+#else
+	inline void begin  (const char*) {}
+	inline void end    (const char*) {}
+	inline void instant(const char*) {}
+	inline void name_thread(const std::string&) {}
+	inline void clear() {}
+	inline void dump(std::ostream& out) { out << "{\"traceEvents\":[]}\n"; }
+#endif
+
+	/**
+	 * Begin/end pair around a scope. `name` must outlive the trace (string
+	 * literal).
+	 */
+	class scope
+	{
+		public:
+			scope(const char* _name) : m_name(_name) { begin(m_name); }
+			~scope() { end(m_name); }
+			scope(const scope&) = delete;
+			scope& operator=(const scope&) = delete;
+		private:
+			const char* m_name;
+	};
+
+}
+
+#endif
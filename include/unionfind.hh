@@ -1,7 +1,9 @@
 #ifndef UNIONFIND_HH
 #define UNIONFIND_HH
 
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 /**
  * UnionFind structure for connected component recognition.
@@ -31,16 +33,10 @@ class UnionFind
 		 */
 		const T& find(const T& a)
 		{
-			try
-			{
-				T& ra = m_mapping.at(a); // throws is no father
-				ra = this->find(ra);     // find root and update father
-				return ra;               // return father
-			}
-			catch (const std::out_of_range&)
-			{
-				return a;                // if no father, we are looking at the root
-			}
+			T* ra = this->father(a);  // nullptr if no father
+			if (!ra) return a;        // if no father, we are looking at the root
+			*ra = this->find(*ra);    // find root and update father
+			return *ra;               // return father
 		}
 		/**
 		 * Merge the components of `a` and `b`
@@ -55,8 +51,93 @@ class UnionFind
 			}
 			return *this;
 		}
+		/**
+		 * Father of `a`, or `a` itself if it is a root (no path compression)
+		 */
+		const T& parent(const T& a) const
+		{
+			const T* ra = this->father(a);
+			return ra ? *ra : a;
+		}
+		/**
+		 * Number of links between `a` and its root (no path compression)
+		 */
+		std::size_t depth(const T& a) const
+		{
+			std::size_t links = 0;
+			for (const T* node = this->father(a); node; node = this->father(*node)) ++links;
+			return links;
+		}
+	private:
+		/**
+		 * Entry of `a` in the mapping, nullptr for a root. Map entries hold
+		 * the father in `second`, DenseMapping entries are the father itself.
+		 */
+		T* father(const T& a)
+		{
+			auto it = m_mapping.find(a);
+			return it == m_mapping.end() ? nullptr : &mapped(*it);
+		}
+		const T* father(const T& a) const
+		{
+			auto it = m_mapping.find(a);
+			return it == m_mapping.end() ? nullptr : &mapped(*it);
+		}
+		template<class Entry> static auto mapped(Entry& entry) -> decltype((entry.second)) { return entry.second; }
+		static T&       mapped(T& father)       { return father; }
+		static const T& mapped(const T& father) { return father; }
 	private:
 		Container m_mapping;
 };
 
+/**
+ * Vector backed container for UnionFind over dense integral keys [0, n).
+ *
+ * An element with no father is stored as its own father, and `find` returns
+ * `end()` for it like a map would for a missing key. Storage grows on
+ * `emplace`, so `n` does not have to be known upfront.
+ */
+template<typename T, class Allocator = std::allocator<T>>
+class DenseMapping
+{
+	public:
+		DenseMapping(std::size_t reserve = 0, const Allocator& alloc = Allocator())
+		: m_fathers(alloc)
+		{
+			m_fathers.reserve(reserve);
+		}
+		using iterator       = typename std::vector<T, Allocator>::iterator;
+		using const_iterator = typename std::vector<T, Allocator>::const_iterator;
+
+		iterator find(const T& key)
+		{
+			return has_father(key) ? m_fathers.begin() + std::ptrdiff_t(key) : m_fathers.end();
+		}
+		const_iterator find(const T& key) const
+		{
+			return has_father(key) ? m_fathers.begin() + std::ptrdiff_t(key) : m_fathers.end();
+		}
+		iterator       end()       { return m_fathers.end(); }
+		const_iterator end() const { return m_fathers.end(); }
+		void emplace(const T& key, const T& value)
+		{
+			std::size_t index  = std::size_t(key);
+			T           father = value; // may refer to our storage, copy before growing
+			while (m_fathers.size() <= index) m_fathers.push_back(T(m_fathers.size()));
+			m_fathers[index] = father;
+		}
+		std::size_t size() const
+		{
+			return m_fathers.size();
+		}
+	private:
+		bool has_father(const T& key) const
+		{
+			std::size_t index = std::size_t(key);
+			return index < m_fathers.size() && m_fathers[index] != key;
+		}
+	private:
+		std::vector<T, Allocator> m_fathers;
+};
+
 #endif
@@ -0,0 +1,460 @@
+#ifndef URING_HH
+#define URING_HH
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "function.hh"
+#include "queue.hh"
+#include "thread.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                           io_uring submission                           */
+	/***************************************************************************/
+	/**
+	 * Minimal io_uring wrapper over the raw system calls (no liburing). Owned
+	 * by a single thread.
+	 */
+	class uring
+	{
+		public:
+			uring(unsigned entries)
+			{
+				io_uring_params params;
+				std::memset(&params, 0, sizeof(params));
+				m_fd.fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+				if (m_fd.fd < 0) throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+
+				// a mapping failing below releases the descriptor and the earlier mappings
+				std::size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				std::size_t cq_size = params.cq_off.cqes  + params.cq_entries * sizeof(io_uring_cqe);
+				bool        single  = params.features & IORING_FEAT_SINGLE_MMAP;
+				if (single) sq_size = cq_size = std::max(sq_size, cq_size);
+				map(m_sq, sq_size, IORING_OFF_SQ_RING);
+				if (!single) map(m_cq, cq_size, IORING_OFF_CQ_RING);
+				map(m_sqes, params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES);
+
+				char* sq = static_cast<char*>(m_sq.address);
+				char* cq = static_cast<char*>(single ? m_sq.address : m_cq.address);
+				m_sq_head  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+				m_sq_tail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+				m_sq_mask  = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+				m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+				m_cq_head  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+				m_cq_tail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+				m_cq_mask  = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+				m_cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+				m_sqe_base = static_cast<io_uring_sqe*>(m_sqes.address);
+				m_entries  = params.sq_entries;
+				m_tail     = *m_sq_tail;
+			}
+			uring(const uring&) = delete;
+			uring& operator=(const uring&) = delete;
+			/**
+			 * Next free submission entry (zeroed), flushing the queue if full
+			 */
+			io_uring_sqe& prepare()
+			{
+				while (m_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_entries) enter(0);
+				unsigned index = m_tail & m_sq_mask;
+				io_uring_sqe& sqe = m_sqe_base[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				m_sq_array[index] = index;
+				++m_tail;
+				return sqe;
+			}
+			/**
+			 * Submit everything prepared, waiting for `wait` completions
+			 */
+			void enter(unsigned wait)
+			{
+				__atomic_store_n(m_sq_tail, m_tail, __ATOMIC_RELEASE);
+				for (;;)
+				{
+					unsigned pending = m_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+					if (::syscall(__NR_io_uring_enter, m_fd.fd, pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0) >= 0) return;
+					if (errno == EINTR) continue;
+					if (errno == EBUSY || errno == EAGAIN) return; // completion queue full: reap first
+					throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+				}
+			}
+			/**
+			 * Hand every available completion to `f(user_data, result)`
+			 */
+			template<class F>
+			unsigned reap(F&& f)
+			{
+				unsigned head = *m_cq_head;
+				unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+				for (unsigned i = head; i != tail; ++i)
+				{
+					const io_uring_cqe& cqe = m_cqes[i & m_cq_mask];
+					f(cqe.user_data, cqe.res);
+				}
+				__atomic_store_n(m_cq_head, tail, __ATOMIC_RELEASE);
+				return tail - head;
+			}
+
+		private:
+			struct descriptor
+			{
+				int fd = -1;
+				~descriptor() { if (fd >= 0) ::close(fd); }
+			};
+			struct mapping
+			{
+				void*       address = nullptr;
+				std::size_t size    = 0;
+				~mapping() { if (address) ::munmap(address, size); }
+			};
+
+			void map(mapping& m, std::size_t size, off_t offset)
+			{
+				void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd.fd, offset);
+				if (p == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "io_uring mmap");
+				m.address = p;
+				m.size    = size;
+			}
+
+		private:
+			descriptor    m_fd;   // declared first: closed after the mappings
+			mapping       m_sq;
+			mapping       m_cq;   // unused with IORING_FEAT_SINGLE_MMAP
+			mapping       m_sqes;
+			io_uring_sqe* m_sqe_base;
+			unsigned*     m_sq_head;
+			unsigned*     m_sq_tail;
+			unsigned*     m_sq_array;
+			unsigned      m_sq_mask;
+			unsigned*     m_cq_head;
+			unsigned*     m_cq_tail;
+			unsigned      m_cq_mask;
+			io_uring_cqe* m_cqes;
+			unsigned      m_entries;
+			unsigned      m_tail; // local submission tail, published by `enter`
+	};
+
+	/***************************************************************************/
+	/*                        io_uring timer/wakeup backend                    */
+	/***************************************************************************/
+	/**
+	 * One thread serving thousands of timers and wakeups through io_uring.
+	 *
+	 * Timers are absolute IORING_OP_TIMEOUT operations, so arming, re-arming
+	 * (periodic timers) and cancelling costs no system call of its own: the
+	 * requests are batched into the `io_uring_enter` the thread makes to wait
+	 * for completions. Other threads hand their requests over through a
+	 * lock-free mailbox, and only the post that finds it empty writes to an
+	 * eventfd the ring keeps a read pending on.
+	 *
+	 * Callbacks run on the ring thread and must not block.
+	 *
+	 * SelfDeletingTimers on the `uring_sleeper` clock policy are served by
+	 * the ring returned by `shared()`. ClockPulser and NotifiedPulser keep
+	 * their own threads, since they run `tick()` on them.
+	 */
+	class UringTimers : public PolymorphicThread<>
+	{
+		public:
+			using callback = inplace_function<void(std::uint64_t), 64>;
+			using timer_id = std::uint64_t;
+
+			class notifier;
+
+		private:
+			struct command : mpsc_node
+			{
+				enum { add, cancel, notify }          kind;
+				timer_id                              id = 0;
+				std::chrono::steady_clock::time_point deadline;
+				std::chrono::steady_clock::duration   period{};
+				callback                              cb;
+				notifier*                             target = nullptr;
+				__kernel_timespec                     spec{}; // read by the kernel at submission
+			};
+			using timer = command;
+
+		public:
+			/**
+			 * NotifiedPulser-style wakeup: `notify()` from any thread runs the
+			 * callback on the ring thread with the number of notifications
+			 * coalesced since its last run. Must outlive its `UringTimers`.
+			 */
+			class notifier
+			{
+				public:
+					notifier(UringTimers& _owner, callback&& _cb)
+					: m_owner(_owner)
+					, m_cb(std::move(_cb))
+					{
+						m_command.kind   = command::notify;
+						m_command.target = this;
+					}
+					notifier(const notifier&) = delete;
+					notifier& operator=(const notifier&) = delete;
+					void notify()
+					{
+						if (m_pending.fetch_add(1, std::memory_order_acq_rel) == 0) m_owner.post(&m_command);
+					}
+				private:
+					friend class UringTimers;
+					UringTimers&               m_owner;
+					std::atomic<std::uint64_t> m_pending = 0;
+					callback                   m_cb;
+					command                    m_command; // queued at most once at a time
+			};
+
+		public:
+			UringTimers(unsigned entries = 4096)
+			: m_ring(entries)
+			, m_wake(::eventfd(0, EFD_CLOEXEC))
+			{
+				if (m_wake < 0) throw std::system_error(errno, std::generic_category(), "eventfd");
+			}
+			UringTimers(const UringTimers&) = delete;
+			UringTimers& operator=(const UringTimers&) = delete;
+			~UringTimers()
+			{
+				if (active())
+				{
+					interrupt();
+					join();
+				}
+				m_mailbox.consume_all([](command* c){ if (c->kind != command::notify) delete c; }); // destroys what callbacks own
+				for (auto& [id, t] : m_timers) delete t;
+				::close(m_wake);
+			}
+
+			/**
+			 * Run `cb` after `delay`, then every `period` if non-zero. Any thread.
+			 */
+			template<class Delay, class Period = Delay>
+			timer_id add_timer(const Delay& delay, callback&& cb, const Period& period = Period::zero())
+			{
+				command* c  = new command;
+				c->kind     = command::add;
+				c->id       = m_ids.fetch_add(1, std::memory_order_relaxed);
+				c->deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay);
+				c->period   = std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+				c->cb       = std::move(cb);
+				timer_id id = c->id;
+				post(c);
+				return id;
+			}
+			/**
+			 * Cancel a pending timer (no effect if it already fired), even one
+			 * whose addition the ring thread did not process yet. Any thread.
+			 */
+			void cancel(timer_id id)
+			{
+				command* c = new command;
+				c->kind    = command::cancel;
+				c->id      = id;
+				post(c);
+			}
+			void interrupt()
+			{
+				m_interrupted = true;
+				signal();
+			}
+			/**
+			 * Process wide ring, started on first use and stopped at exit
+			 */
+			static UringTimers& shared()
+			{
+				struct started : UringTimers { started() { start(); } };
+				static started global;
+				return global;
+			}
+
+		private:
+
+			static constexpr std::uint64_t wake_tag   = 0; // eventfd read
+			static constexpr std::uint64_t ignore_tag = 1; // timeout removals
+			static constexpr timer_id      first_id   = 2;
+
+			void post(command* c)
+			{
+				if (m_mailbox.push(c) == mpsc_push::first) signal();
+			}
+			void signal()
+			{
+				std::uint64_t one = 1;
+				while (::write(m_wake, &one, sizeof(one)) < 0 && errno == EINTR);
+			}
+			void arm_wake()
+			{
+				io_uring_sqe& sqe = m_ring.prepare();
+				sqe.opcode    = IORING_OP_READ;
+				sqe.fd        = m_wake;
+				sqe.addr      = reinterpret_cast<std::uint64_t>(&m_wake_buffer);
+				sqe.len       = sizeof(m_wake_buffer);
+				sqe.user_data = wake_tag;
+			}
+			void arm(timer* t)
+			{
+				auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t->deadline.time_since_epoch()).count();
+				t->spec.tv_sec  = ns / 1000000000;
+				t->spec.tv_nsec = ns % 1000000000;
+				io_uring_sqe& sqe = m_ring.prepare();
+				sqe.opcode        = IORING_OP_TIMEOUT;
+				sqe.fd            = -1;
+				sqe.addr          = reinterpret_cast<std::uint64_t>(&t->spec);
+				sqe.len           = 1;
+				sqe.timeout_flags = IORING_TIMEOUT_ABS;
+				sqe.user_data     = t->id;
+			}
+			void disarm(timer_id id)
+			{
+				io_uring_sqe& sqe = m_ring.prepare();
+				sqe.opcode    = IORING_OP_TIMEOUT_REMOVE;
+				sqe.fd        = -1;
+				sqe.addr      = id;
+				sqe.user_data = ignore_tag;
+			}
+			void handle(command* c)
+			{
+				switch (c->kind)
+				{
+					case command::add:
+						added(c->id);
+						if (m_cancelled.erase(c->id)) { delete c; break; }
+						m_timers.emplace(c->id, c);
+						arm(c);
+						break;
+					case command::cancel:
+						if (m_timers.count(c->id)) disarm(c->id);
+						else if (!was_added(c->id) && c->id < m_ids.load(std::memory_order_relaxed)) m_cancelled.insert(c->id); // drop the add once it comes
+						delete c;
+						break;
+					case command::notify:
+					{
+						notifier* n = c->target;
+						std::uint64_t count = n->m_pending.exchange(0, std::memory_order_acq_rel);
+						if (count) n->m_cb(count);
+						break;
+					}
+				}
+			}
+			/**
+			 * Additions are processed out of id order when several threads add
+			 * timers, ids below `m_added` and those in `m_added_ahead` were seen
+			 */
+			void added(timer_id id)
+			{
+				m_added_ahead.insert(id);
+				while (m_added_ahead.erase(m_added)) ++m_added;
+			}
+			bool was_added(timer_id id) const
+			{
+				return id < m_added || m_added_ahead.count(id);
+			}
+			void complete(std::uint64_t tag, int result)
+			{
+				if (tag == wake_tag)   { arm_wake(); return; }
+				if (tag == ignore_tag) { return; }
+				auto it = m_timers.find(tag);
+				if (it == m_timers.end()) return;
+				timer* t = it->second;
+				if (result == -ETIME)
+				{
+					t->cb(1);
+					if (t->period > std::chrono::steady_clock::duration::zero())
+					{
+						t->deadline += t->period;
+						arm(t);
+						return;
+					}
+				}
+				m_timers.erase(it);
+				delete t;
+			}
+			void run() final
+			{
+				arm_wake();
+				while (!m_interrupted)
+				{
+					m_mailbox.consume_all([this](command* c){ handle(c); });
+					m_ring.enter(1);
+					m_ring.reap([this](std::uint64_t tag, int result){ complete(tag, result); });
+				}
+			}
+
+		private:
+			uring                                  m_ring;
+			const int                              m_wake;
+			std::uint64_t                          m_wake_buffer = 0;
+			std::atomic<bool>                      m_interrupted = false;
+			std::atomic<timer_id>                  m_ids = first_id;
+			mpsc_queue<command>                    m_mailbox;
+			std::unordered_map<timer_id, timer*>   m_timers;      // ring thread only
+			timer_id                               m_added = first_id;
+			std::unordered_set<timer_id>           m_added_ahead; // ring thread only
+			std::unordered_set<timer_id>           m_cancelled;   // cancelled before being added, ring thread only
+	};
+
+	/**
+	 * Real time clock policy, like `steady_sleeper`, whose SelfDeletingTimers
+	 * are io_uring timeouts of `UringTimers::shared()` instead of entries of
+	 * a timer thread
+	 */
+	struct uring_sleeper : steady_sleeper
+	{
+	};
+
+	namespace detail
+	{
+		/**
+		 * Timers are submitted to the shared ring and fire on its thread. An
+		 * interrupted timer is released when it comes due, without firing. The
+		 * ring's callback owns the timer, so a timer still pending when the
+		 * ring is destroyed is released with it.
+		 */
+		template<class Timer>
+		class timer_service<Timer, uring_sleeper>
+		{
+			public:
+				static timer_service& instance()
+				{
+					static timer_service global;
+					return global;
+				}
+				void schedule(Timer* timer)
+				{
+					UringTimers::shared().add_timer(timer->m_due - uring_sleeper::now(), [owned = std::unique_ptr<Timer>(timer)](std::uint64_t) mutable
+					{
+						owned->fire();
+						owned.reset();
+					});
+				}
+				void sweep()
+				{
+				}
+		};
+	}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef WATCHDOG_HH
+#define WATCHDOG_HH
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "clock.hh"
+#include "thread.hh"
+
+namespace madag::sync
+{
+
+	/***************************************************************************/
+	/*                                Watchdog                                 */
+	/***************************************************************************/
+	/**
+	 * What a watchdog noticed about a pulser, times in nanoseconds of the
+	 * steady clock
+	 */
+	struct stall_report
+	{
+		enum kind_t
+		{
+			overrun, // a tick has been running longer than its deadline
+			silent,  // no tick started for longer than the allowed silence
+		};
+
+		kind_t       kind;
+		std::string  name;       // from the pulser's thread_options, unless given explicitly
+		std::int64_t tick_start; // start of the offending (or last) tick, 0 if it never ticked
+		std::int64_t duration;   // time spent in the tick so far, or silent for
+	};
+
+	/**
+	 * Pulser checking the heartbeats of other pulsers every interval. Each
+	 * watched pulser has a tick deadline and optionally a maximal silence
+	 * between ticks (leave it zero for pulsers idling on notifications). The
+	 * callback runs on the watchdog thread once per incident: again only after
+	 * the pulser recovered. Watched pulsers must be unwatched before they are
+	 * destroyed.
+	 */
+	template<class I, class C = steady_sleeper>
+	class Watchdog : public ClockPulser<I, C>
+	{
+		public:
+			using interval = I;
+			using callback = std::function<void(const stall_report&)>;
+
+		public:
+			Watchdog(const interval& _interval, callback&& _callback)
+			: ClockPulser<I, C>(_interval)
+			, m_callback(std::move(_callback))
+			{
+			}
+
+			template<class Deadline, class Silence = Deadline>
+			void watch(const PulserBase<>& pulser, const Deadline& deadline, const Silence& silence = Silence::zero(), const std::string& name = std::string())
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_watched.push_back({
+					&pulser,
+					name.empty() ? pulser.options().name : name,
+					std::chrono::duration_cast<std::chrono::nanoseconds>(deadline).count(),
+					std::chrono::duration_cast<std::chrono::nanoseconds>(silence).count(),
+					now(),
+				});
+				pulser.track_heartbeat(true);
+			}
+			void unwatch(const PulserBase<>& pulser)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				for (std::size_t i = 0; i < m_watched.size(); )
+				{
+					if (m_watched[i].pulser == &pulser)
+					{
+						pulser.track_heartbeat(false);
+						m_watched[i] = std::move(m_watched.back());
+						m_watched.pop_back();
+					}
+					else ++i;
+				}
+			}
+
+		private:
+			struct entry
+			{
+				const PulserBase<>* pulser;
+				std::string         name;
+				std::int64_t        deadline;
+				std::int64_t        silence;
+				std::int64_t        since;             // watched since
+				std::int64_t        reported_tick = 0; // tick start already reported
+				bool                silent        = false;
+			};
+
+			static std::int64_t now()
+			{
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			void tick() final
+			{
+				std::vector<stall_report> reports;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					std::int64_t current = now();
+					for (entry& e : m_watched)
+					{
+						heartbeat beat = e.pulser->last_heartbeat();
+						bool running = beat.tick_start > beat.tick_end;
+						if (running && current - beat.tick_start > e.deadline && e.reported_tick != beat.tick_start)
+						{
+							e.reported_tick = beat.tick_start;
+							reports.push_back({ stall_report::overrun, e.name, beat.tick_start, current - beat.tick_start });
+						}
+						std::int64_t last = std::max(beat.tick_start, e.since);
+						bool quiet = e.silence && !running && current - last > e.silence;
+						if (quiet && !e.silent)
+						{
+							reports.push_back({ stall_report::silent, e.name, beat.tick_start, current - last });
+						}
+						e.silent = quiet;
+					}
+				}
+				for (const stall_report& report : reports) m_callback(report);
+			}
+
+		private:
+			callback           m_callback;
+			std::mutex         m_mutex;
+			std::vector<entry> m_watched;
+	};
+
+}
+
+#endif